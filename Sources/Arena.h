@@ -0,0 +1,169 @@
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Arena.h
+
+// An arena: allocation bumps a pointer through large blocks, and reset()
+// frees everything at once.  Small blocks that are given back go on a free
+// list for their size and are handed out again first, so a container that
+// inserts and erases (a std::set used as a priority queue) keeps reusing the
+// same cache-warm memory; bigger ones are only reclaimed by reset().  When a
+// round needed more than one block, reset() replaces them with a single block
+// big enough for the whole round, so a workload that repeats (one search
+// after another) soon allocates nothing from the system at all.
+//
+// ArenaAllocator lets standard containers and ExpandableHashMap draw from an
+// arena.  Containers using it must be gone before the arena is reset.
+
+const size_t ARENA_POOLED_BYTES = 256; // blocks up to this size are recycled
+const size_t ARENA_POOL_GRAIN = 8;
+
+class Arena
+{
+public:
+    Arena(size_t firstBlockSize = 64 << 10)
+     : m_next(nullptr), m_end(nullptr), m_used(0), m_blockSize(firstBlockSize > 0 ? firstBlockSize : 1)
+    {
+        clearPools();
+    }
+
+    ~Arena()
+    {
+        for (char* block : m_blocks)
+            std::free(block);
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        if (pooled(bytes, alignment))
+        {
+            bytes = poolSize(bytes);
+            FreeBlock*& head = m_pools[bytes / ARENA_POOL_GRAIN];
+            if (head != nullptr)
+            {
+                FreeBlock* block = head;
+                head = block->next;
+                return block;
+            }
+            alignment = ARENA_POOL_GRAIN;
+        }
+        size_t padding = (alignment - reinterpret_cast<size_t>(m_next) % alignment) % alignment;
+        if (m_next == nullptr || bytes + padding > (size_t)(m_end - m_next))
+        {
+            addBlock(bytes + alignment);
+            padding = (alignment - reinterpret_cast<size_t>(m_next) % alignment) % alignment;
+        }
+        char* result = m_next + padding;
+        m_next = result + bytes;
+        m_used += bytes + padding;
+        return result;
+    }
+
+      // give back a block from allocate(bytes, alignment)
+    void release(void* p, size_t bytes, size_t alignment)
+    {
+        if (!pooled(bytes, alignment)) return; // reclaimed at reset
+        bytes = poolSize(bytes);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = m_pools[bytes / ARENA_POOL_GRAIN];
+        m_pools[bytes / ARENA_POOL_GRAIN] = block;
+    }
+
+      // free every allocation; keeps (or makes) one block the size of this round
+    void reset()
+    {
+        clearPools();
+        if (m_blocks.size() > 1)
+        {
+            for (char* block : m_blocks)
+                std::free(block);
+            m_blocks.clear();
+            if (m_used > m_blockSize) m_blockSize = m_used;
+            addBlock(m_blockSize);
+        }
+        else if (!m_blocks.empty())
+            m_next = m_blocks[0];
+        m_used = 0;
+    }
+
+    size_t bytesUsed() const { return m_used; }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    std::vector<char*> m_blocks;
+    FreeBlock* m_pools[ARENA_POOLED_BYTES / ARENA_POOL_GRAIN + 1];  // free lists by size
+    char*  m_next;
+    char*  m_end;
+    size_t m_used;       // this round, padding included
+    size_t m_blockSize;  // size of the next block
+
+    static bool pooled(size_t bytes, size_t alignment)
+    {
+        return bytes <= ARENA_POOLED_BYTES && alignment <= ARENA_POOL_GRAIN;
+    }
+
+      // the size class of a pooled block: whole grains, and room for the free list link
+    static size_t poolSize(size_t bytes)
+    {
+        return bytes == 0 ? ARENA_POOL_GRAIN : (bytes + ARENA_POOL_GRAIN - 1) / ARENA_POOL_GRAIN * ARENA_POOL_GRAIN;
+    }
+
+    void clearPools()
+    {
+        for (FreeBlock*& head : m_pools)
+            head = nullptr;
+    }
+
+    void addBlock(size_t minimum)
+    {
+        if (!m_blocks.empty()) m_blockSize *= 2; // each block twice the last
+        if (m_blockSize < minimum) m_blockSize = minimum;
+        char* block = static_cast<char*>(std::malloc(m_blockSize));
+        if (block == nullptr) throw std::bad_alloc();
+        m_blocks.push_back(block);
+        m_next = block;
+        m_end = block + m_blockSize;
+    }
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, size_t n) { m_arena->release(p, n * sizeof(T), alignof(T)); }
+    Arena* arena() const { return m_arena; }
+private:
+    Arena* m_arena;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+    return lhs.arena() == rhs.arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+    return lhs.arena() != rhs.arena();
+}
+
+#endif // ARENA_INCLUDED
@@ -0,0 +1,557 @@
+#include "CellOverlay.h"
+#include "MapParser.h"
+#include "SearchWorkspace.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+using namespace std;
+
+const uint32_t NOT_BOUNDARY = 0xFFFFFFFF;
+const uint16_t NO_PARENT = 0xFFFF;  // in a tree: the source, or not reached
+enum { THROUGH_UNKNOWN, THROUGH_NO, THROUGH_YES };
+
+CellOverlay::CellOverlay()
+ : m_graph(nullptr), m_levelCount(0)
+{
+}
+
+void CellOverlay::clear()
+{
+    m_graph = nullptr;
+    m_levelCount = 0;
+    for (Level& level : m_levels)
+        level = Level();
+    m_points.clear();
+    lock_guard<mutex> hold(m_metricLock);
+    m_metric.reset();
+}
+
+void CellOverlay::build(const StreetGraph& graph, ThreadPool* pool)
+{
+    clear();
+    m_graph = &graph;
+    uint32_t n = graph.nodeCount();
+    // each level's cells hold 8 of the one below, so this stops after
+    // 1 + log8(n / 2048) levels, rounded up: 3 for mapdata.txt, 6 for a map
+    // 500 times bigger
+    while (m_levelCount < OVERLAY_MAX_LEVELS && (m_levelCount == 0 || cellCount(m_levelCount) > OVERLAY_TOP_CELLS)
+           && partition(m_levelCount + 1))
+        m_levelCount++;
+    for (int l = 1; l < m_levelCount; l++) // the top level keeps no trees
+    {
+        Level& level = m_levels[l - 1];
+        level.treeOffsets.assign(cellCount(l), 0);
+        level.treeSize = 0;
+        for (uint32_t c = 0; c < cellCount(l); c++)
+        {
+            level.treeOffsets[c] = level.treeSize;
+            size_t count = level.boundaryOffsets[c + 1] - level.boundaryOffsets[c];
+            level.treeSize += count * innerCount(l, c);
+        }
+    }
+    const double radiusMiles = 6371.0 / 1.609344; // the one distanceEarthMiles uses
+    m_points.resize(3 * (size_t)n);
+    for (NodeId v = 0; v < n; v++)
+    {
+        double lat = deg2rad(graph.latitude(v)), lon = deg2rad(graph.longitude(v));
+        m_points[3 * (size_t)v] = radiusMiles * cos(lat) * cos(lon);
+        m_points[3 * (size_t)v + 1] = radiusMiles * cos(lat) * sin(lon);
+        m_points[3 * (size_t)v + 2] = radiusMiles * sin(lat);
+    }
+    vector<double> lengths(graph.edgeCount());
+    for (EdgeId e = 0; e < graph.edgeCount(); e++)
+        lengths[e] = graph.edgeLength(e);
+    customize(lengths, pool);
+}
+
+bool CellOverlay::readTraffic(const string& file, vector<double>& weights, string& error) const
+{
+    const StreetGraph& graph = *m_graph;
+    weights.resize(graph.edgeCount());
+    for (EdgeId e = 0; e < graph.edgeCount(); e++)
+        weights[e] = graph.edgeLength(e);
+    ifstream in(file);
+    if (!in)
+    {
+        error = file + ": cannot open";
+        return false;
+    }
+    string line;
+    for (size_t lineNumber = 1; getline(in, line); lineNumber++)
+    {
+        string where = file + ":" + to_string(lineNumber) + ": ";
+        istringstream words(line);
+        string text[5];
+        if (!(words >> text[0]) || text[0][0] == '#') continue; // blank, or a comment
+        if (!(words >> text[1] >> text[2] >> text[3] >> text[4]))
+        {
+            error = where + "expected start lat/lon, end lat/lon and a factor";
+            return false;
+        }
+        double value;
+        for (int i = 0; i < 4; i++)
+        {
+            if (!parseCoordinate(text[i].data(), text[i].data() + text[i].size(), value))
+            {
+                error = where + "\"" + text[i] + "\" is not a coordinate";
+                return false;
+            }
+        }
+        double factor = numeric_limits<double>::infinity();
+        if (text[4] != "closed")
+        {
+            char* end;
+            factor = strtod(text[4].c_str(), &end);
+            if (*end != '\0' || !(factor >= 0) || factor == numeric_limits<double>::infinity())
+            {
+                error = where + "\"" + text[4] + "\" is neither a factor nor \"closed\"";
+                return false;
+            }
+        }
+        NodeId a = graph.findNode(GeoCoord(text[0], text[1]));
+        NodeId b = graph.findNode(GeoCoord(text[2], text[3]));
+        bool found = false;
+        for (int way = 0; way < 2 && a != NO_NODE && b != NO_NODE; way++)
+        {
+            NodeId from = way == 0 ? a : b, to = way == 0 ? b : a;
+            for (EdgeId e = graph.edgeBegin(from); e < graph.edgeEnd(from); e++)
+            {
+                if (graph.edgeTarget(e) != to) continue;
+                // a closed segment of no length is still closed
+                weights[e] = text[4] == "closed" ? factor : graph.edgeLength(e) * factor;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            error = where + "no segment of the map joins these coordinates";
+            return false;
+        }
+    }
+    return true;
+}
+
+void CellOverlay::customize(const vector<double>& weights, ThreadPool* pool)
+{
+    shared_ptr<Metric> m = make_shared<Metric>();
+    m->weights = weights;
+    m->costPerMile = numeric_limits<double>::infinity();
+    for (EdgeId e = 0; e < m_graph->edgeCount(); e++)
+    {
+        if (m_graph->edgeLength(e) > 0)
+            m->costPerMile = min(m->costPerMile, weights[e] / m_graph->edgeLength(e));
+    }
+    if (m->costPerMile == numeric_limits<double>::infinity()) // every segment closed or of no length
+        m->costPerMile = 0;
+    for (int l = 1; l <= m_levelCount; l++)
+    {
+        uint32_t cells = cellCount(l);
+        vector<uint32_t>& rows = m->cliqueRows[l - 1];
+        rows.assign(m_levels[l - 1].boundary.size() + 1, 0);
+        m->trees[l - 1].assign(m_levels[l - 1].treeSize, NO_PARENT);
+        // Each level needs the one below finished; its cells only write their
+        // own rows.  How many arcs a row keeps is only known once its cell is
+        // done, so the cells' rows are gathered into the level's afterwards.
+        vector<vector<double>> costs(cells);
+        vector<vector<uint16_t>> targets(cells);
+        if (pool == nullptr || pool->threadCount() <= 1)
+        {
+            SearchWorkspace workspace;
+            for (uint32_t c = 0; c < cells; c++)
+                customizeCell(*m, l, c, workspace.forward(), costs[c], targets[c]);
+        }
+        else
+        {
+            vector<unique_ptr<SearchWorkspace>> workspaces(pool->threadCount());
+            pool->parallelFor(cells, [&](size_t c, unsigned int thread) {
+                if (workspaces[thread] == nullptr)
+                    workspaces[thread].reset(new SearchWorkspace);
+                customizeCell(*m, l, (uint32_t)c, workspaces[thread]->forward(), costs[c], targets[c]);
+            });
+        }
+        for (size_t i = 1; i < rows.size(); i++)
+            rows[i] += rows[i - 1];
+        m->cliques[l - 1].reserve(rows.back());
+        m->cliqueTargets[l - 1].reserve(rows.back());
+        for (uint32_t c = 0; c < cells; c++)
+        {
+            m->cliques[l - 1].insert(m->cliques[l - 1].end(), costs[c].begin(), costs[c].end());
+            m->cliqueTargets[l - 1].insert(m->cliqueTargets[l - 1].end(), targets[c].begin(), targets[c].end());
+            vector<double>().swap(costs[c]);
+            vector<uint16_t>().swap(targets[c]);
+        }
+    }
+    lock_guard<mutex> hold(m_metricLock);
+    m_metric = m;
+}
+
+shared_ptr<const CellOverlay::Metric> CellOverlay::metric() const
+{
+    lock_guard<mutex> hold(m_metricLock);
+    return m_metric;
+}
+
+bool CellOverlay::route(const Metric& m, NodeId start, NodeId end, SearchWorkspace& workspace,
+                        vector<SegmentRef>& route, double& cost) const
+{
+    // A* from both ends at once over the overlay, the side with the smaller
+    // key going next, until the two smallest keys add up to no less than the
+    // best meeting.  As in PointToPointRouter's bidirectional search, both
+    // share the average potential p(v) = (h(v, end) - h(start, v)) / 2,
+    // forward with +p and backward with -p; h is the chord times the
+    // metric's cheapest cost per mile, so it never overestimates under any
+    // traffic.  Costs are the same both ways, so the backward search follows
+    // the arcs leaving a node.  A label's first is the level of the arc it
+    // was reached by, and edge the edge for level 0 (on the backward side,
+    // its twin back to the parent).
+    route.clear();
+    cost = 0;
+    workspace.begin(m_graph->nodeCount());
+    if (start == end) return true;
+    auto potential = [&](NodeId v) {
+        return m.costPerMile * (chordMiles(v, end) - chordMiles(start, v)) / 2;
+    };
+    SearchSide& forward = workspace.forward();
+    SearchSide& backward = workspace.backward();
+    forward.label(start).g = 0;
+    forward.open().pushOrDecrease(start, potential(start));
+    backward.label(end).g = 0;
+    backward.open().pushOrDecrease(end, -potential(end));
+
+    double best = numeric_limits<double>::infinity();
+    NodeId meet = NO_NODE;
+    while (!forward.open().empty() && !backward.open().empty() &&
+           forward.open().topKey() + backward.open().topKey() < best)
+    {
+        bool forwards = forward.open().topKey() <= backward.open().topKey();
+        SearchSide& side = forwards ? forward : backward;
+        SearchSide& other = forwards ? backward : forward;
+        double sign = forwards ? 1 : -1; // of the potential
+        NodeId curr = side.open().pop();
+        SearchLabel& here = side.label(curr);
+        here.closed = true;
+        workspace.countExpanded();
+        arcsFrom(m, queryLevel(curr, start, end), curr, 0, 0, [&](NodeId to, double arcCost, int level, EdgeId edge) {
+            EdgeId taken = forwards || level > 0 ? edge : m_graph->reverseEdge(edge);
+            if (taken == NO_EDGE) return; // a one-way segment, not usable backward
+            double distance = here.g + arcCost;
+            SearchLabel& reached = side.label(to);
+            if (reached.closed || distance >= reached.g) return;
+            reached.g = distance;
+            reached.parent = curr;
+            reached.first = level;
+            reached.edge = taken;
+            side.open().pushOrDecrease(to, distance + sign * potential(to));
+            if (distance + other.g(to) < best)
+            {
+                best = distance + other.g(to);
+                meet = to;
+            }
+        });
+    }
+    if (meet == NO_NODE) return false;
+    cost = best;
+
+    // the steps from start to meet and on to end
+    vector<Step> steps;
+    for (NodeId v = meet; v != start; v = forward.parent(v))
+    {
+        const SearchLabel& reached = forward.label(v);
+        Step step = { reached.parent, v, (int)reached.first, reached.edge };
+        steps.push_back(step);
+    }
+    reverse(steps.begin(), steps.end());
+    for (NodeId v = meet; v != end; v = backward.parent(v))
+    {
+        // the backward search went from parent to v; the route goes back
+        const SearchLabel& reached = backward.label(v);
+        Step step = { v, reached.parent, (int)reached.first, reached.edge };
+        steps.push_back(step);
+    }
+    for (const Step& step : steps) // the forward labels are no longer needed
+    {
+        if (step.level == 0)
+            route.push_back(SegmentRef(m_graph, step.from, step.edge));
+        else
+            unpack(m, step, forward, route);
+    }
+    return true;
+}
+
+size_t CellOverlay::memoryUsage() const
+{
+    size_t bytes = 0;
+    for (const Level& level : m_levels)
+        bytes += level.boundaryOffsets.capacity() * sizeof(uint32_t) + level.boundary.capacity() * sizeof(NodeId) +
+                 level.treeOffsets.capacity() * sizeof(size_t) + level.position.capacity() * sizeof(uint32_t);
+    bytes += m_points.capacity() * sizeof(double);
+    shared_ptr<const Metric> m = metric();
+    if (m != nullptr)
+    {
+        bytes += m->weights.capacity() * sizeof(double);
+        for (int l = 0; l < m_levelCount; l++)
+            bytes += m->cliques[l].capacity() * sizeof(double) + m->cliqueTargets[l].capacity() * sizeof(uint16_t) +
+                     m->cliqueRows[l].capacity() * sizeof(uint32_t);
+        for (const vector<uint16_t>& trees : m->trees)
+            bytes += trees.capacity() * sizeof(uint16_t);
+    }
+    return bytes;
+}
+
+// PRIVATE MEMBER FUNCTIONS
+
+bool CellOverlay::isBoundary(int level, NodeId n) const
+{
+    return m_levels[level - 1].position[n] != NOT_BOUNDARY;
+}
+
+bool CellOverlay::partition(int l)
+{
+    // cells are runs of ids, so going through the nodes in order lists the
+    // boundary cell by cell
+    const StreetGraph& graph = *m_graph;
+    uint32_t n = graph.nodeCount();
+    Level& level = m_levels[l - 1];
+    uint32_t cells = n == 0 ? 0 : cell(l, n - 1) + 1;
+    level.position.assign(n, NOT_BOUNDARY);
+    level.boundaryOffsets.assign(cells + 1, 0);
+    for (NodeId v = 0; v < n; v++)
+    {
+        for (EdgeId e = graph.edgeBegin(v); e < graph.edgeEnd(v); e++)
+        {
+            if (cell(l, graph.edgeTarget(e)) == cell(l, v)) continue;
+            level.position[v] = (uint32_t)(level.boundary.size() - level.boundaryOffsets[cell(l, v)]);
+            level.boundary.push_back(v);
+            break;
+        }
+        level.boundaryOffsets[cell(l, v) + 1] = (uint32_t)level.boundary.size();
+    }
+    // a clique names its targets by a 16-bit index, and a level that is no
+    // longer the top keeps trees of 16-bit parents, NO_PARENT excepted
+    bool fits = true;
+    for (uint32_t c = 0; fits && c < cells; c++)
+        fits = level.boundaryOffsets[c + 1] - level.boundaryOffsets[c] <= 0x10000;
+    for (uint32_t c = 0; fits && l > 1 && c < cellCount(l - 1); c++)
+        fits = innerCount(l - 1, c) < NO_PARENT;
+    if (!fits)
+        level = Level();
+    return fits;
+}
+
+double CellOverlay::chordMiles(NodeId a, NodeId b) const
+{
+    const double* p = &m_points[3 * (size_t)a];
+    const double* q = &m_points[3 * (size_t)b];
+    return sqrt((p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]));
+}
+
+uint32_t CellOverlay::innerCount(int level, uint32_t c) const
+{
+    if (level == 1)
+    {
+        NodeId first = c << cellBits(1);
+        return min(m_graph->nodeCount() - first, (uint32_t)1 << cellBits(1));
+    }
+    const Level& below = m_levels[level - 2];
+    uint32_t firstCell = c << OVERLAY_CELL_BITS_STEP;
+    uint32_t lastCell = min((c + 1) << OVERLAY_CELL_BITS_STEP, cellCount(level - 1));
+    return below.boundaryOffsets[lastCell] - below.boundaryOffsets[firstCell];
+}
+
+uint32_t CellOverlay::innerIndex(int level, NodeId n) const
+{
+    if (level == 1)
+        return n - (cell(1, n) << cellBits(1));
+    const Level& below = m_levels[level - 2];
+    return below.boundaryOffsets[cell(level - 1, n)] + below.position[n] -
+           below.boundaryOffsets[cell(level, n) << OVERLAY_CELL_BITS_STEP];
+}
+
+NodeId CellOverlay::innerNode(int level, uint32_t c, uint32_t index) const
+{
+    if (level == 1)
+        return (c << cellBits(1)) + index;
+    const Level& below = m_levels[level - 2];
+    return below.boundary[below.boundaryOffsets[c << OVERLAY_CELL_BITS_STEP] + index];
+}
+
+int CellOverlay::queryLevel(NodeId n, NodeId start, NodeId end) const
+{
+    for (int l = m_levelCount; l > 0; l--)
+    {
+        uint32_t c = cell(l, n);
+        if (c != cell(l, start) && c != cell(l, end))
+            return l;
+    }
+    return 0;
+}
+
+template<typename Visit>
+void CellOverlay::arcsFrom(const Metric& m, int level, NodeId n, int withinLevel, uint32_t within, Visit visit) const
+{
+    const StreetGraph& graph = *m_graph;
+    uint32_t home = level > 0 ? cell(level, n) : 0;
+    if (level > 0 && isBoundary(level, n)) // a search only ever reaches boundary nodes at its level
+    {
+        const Level& lv = m_levels[level - 1];
+        uint32_t first = lv.boundaryOffsets[home];
+            uint32_t i = first + lv.position[n];
+        const vector<uint32_t>& rows = m.cliqueRows[level - 1];
+        const double* costs = m.cliques[level - 1].data();
+        const uint16_t* targets = m.cliqueTargets[level - 1].data();
+        for (uint32_t a = rows[i]; a < rows[i + 1]; a++)
+            visit(lv.boundary[first + targets[a]], costs[a], level, (EdgeId)0);
+    }
+    for (EdgeId e = graph.edgeBegin(n); e < graph.edgeEnd(n); e++)
+    {
+        NodeId to = graph.edgeTarget(e);
+        if (level > 0 && cell(level, to) == home) continue; // inside the cell: the clique has it
+        if (withinLevel > 0 && cell(withinLevel, to) != within) continue;
+        visit(to, m.weights[e], 0, e);
+    }
+}
+
+void CellOverlay::searchCell(const Metric& m, int level, NodeId source, SearchSide& side, NodeId stop) const
+{
+    side.begin(m_graph->nodeCount());
+    uint32_t home = cell(level, source);
+    IndexedHeap& open = side.open();
+    side.label(source).g = 0;
+    open.pushOrDecrease(source, 0);
+    while (!open.empty())
+    {
+        NodeId curr = open.pop();
+        SearchLabel& here = side.label(curr);
+        here.closed = true;
+        if (curr == stop) return;
+        arcsFrom(m, level - 1, curr, level, home, [&](NodeId to, double arcCost, int arcLevel, EdgeId edge) {
+            double distance = here.g + arcCost;
+            SearchLabel& reached = side.label(to);
+            if (reached.closed || distance >= reached.g) return;
+            reached.g = distance;
+            reached.parent = curr;
+            reached.first = arcLevel;
+            reached.edge = edge;
+            open.pushOrDecrease(to, distance);
+        });
+    }
+}
+
+void CellOverlay::customizeCell(Metric& m, int level, uint32_t c, SearchSide& side,
+                                vector<double>& costs, vector<uint16_t>& targets) const
+{
+    const Level& lv = m_levels[level - 1];
+    uint32_t first = lv.boundaryOffsets[c];
+    uint32_t count = lv.boundaryOffsets[c + 1] - first;
+    uint32_t inner = innerCount(level, c);
+    uint16_t* tree = lv.treeOffsets.empty() || count == 0 ? nullptr : &m.trees[level - 1][lv.treeOffsets[c]];
+    vector<uint32_t> parents(inner);  // per inner node: its parent's inner index, or NO_NODE
+    vector<uint8_t> through(inner);   // per inner node: unknown, or whether its path passes a boundary node
+    vector<uint32_t> pending;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        NodeId source = lv.boundary[first + i];
+        searchCell(m, level, source, side);
+        // every node the search reached was reached from another inner node
+        for (uint32_t k = 0; k < inner; k++)
+        {
+            NodeId parent = side.parent(innerNode(level, c, k));
+            parents[k] = parent == NO_NODE ? NO_NODE : innerIndex(level, parent);
+            if (tree != nullptr)
+                tree[(size_t)i * inner + k] = parent == NO_NODE ? NO_PARENT : (uint16_t)parents[k];
+        }
+        // A route to another boundary node that passes a third is left out
+        // of the clique: the cliques of that third one give the same cost,
+        // and queries and the level above then have fewer arcs to follow.
+        fill(through.begin(), through.end(), THROUGH_UNKNOWN);
+        uint32_t arcs = 0;
+        for (uint32_t j = 0; j < count; j++)
+        {
+            NodeId target = lv.boundary[first + j];
+            double g = side.g(target);
+            uint8_t answer = THROUGH_NO;
+            for (uint32_t k = innerIndex(level, target); g != numeric_limits<double>::infinity() && parents[k] != NO_NODE; )
+            {
+                NodeId parent = innerNode(level, c, parents[k]);
+                if (parent == source) break;
+                if (isBoundary(level, parent) || through[parents[k]] == THROUGH_YES)
+                {
+                    answer = THROUGH_YES;
+                    break;
+                }
+                if (through[parents[k]] == THROUGH_NO) break;
+                pending.push_back(parents[k]);
+                k = parents[k];
+            }
+            for (uint32_t k : pending)
+                through[k] = answer;
+            pending.clear();
+            if (j == i || answer == THROUGH_YES || g == numeric_limits<double>::infinity()) continue;
+            costs.push_back(g);
+            targets.push_back((uint16_t)j);
+            arcs++;
+        }
+        m.cliqueRows[level - 1][first + i + 1] = arcs;
+    }
+}
+
+void CellOverlay::unpack(const Metric& m, const Step& step, SearchSide& side, vector<SegmentRef>& route) const
+{
+    // the clique entry is the cost to step.to in the tree grown from
+    // step.from, so its path is step.to's parents back to step.from
+    vector<Step> path;
+    const Level& lv = m_levels[step.level - 1];
+    uint32_t c = cell(step.level, step.from);
+    if (lv.treeOffsets.empty())
+    {
+        // no trees at the top: grow step.from's again, as far as step.to,
+        // and follow the arcs its labels were reached by
+        searchCell(m, step.level, step.from, side, step.to);
+        for (NodeId v = step.to; v != step.from; v = side.parent(v))
+        {
+            const SearchLabel& reached = side.label(v);
+            Step s = { reached.parent, v, (int)reached.first, reached.edge };
+            path.push_back(s);
+        }
+    }
+    else
+    {
+        // inside one cell of the level below, its clique; between two, a segment
+        uint32_t inner = innerCount(step.level, c);
+        const uint16_t* parents = &m.trees[step.level - 1][lv.treeOffsets[c] + (size_t)lv.position[step.from] * inner];
+        for (NodeId v = step.to; v != step.from; )
+        {
+            NodeId parent = innerNode(step.level, c, parents[innerIndex(step.level, v)]);
+            bool inside = step.level > 1 && cell(step.level - 1, parent) == cell(step.level - 1, v);
+            Step s = { parent, v, inside ? step.level - 1 : 0, inside ? 0 : edgeBetween(m, parent, v) };
+            path.push_back(s);
+            v = parent;
+        }
+    }
+    reverse(path.begin(), path.end());
+    for (const Step& s : path)
+    {
+        if (s.level == 0)
+            route.push_back(SegmentRef(m_graph, s.from, s.edge));
+        else
+            unpack(m, s, side, route);
+    }
+}
+
+EdgeId CellOverlay::edgeBetween(const Metric& m, NodeId from, NodeId to) const
+{
+    const StreetGraph& graph = *m_graph;
+    EdgeId best = graph.edgeBegin(from);
+    bool found = false;
+    for (EdgeId e = graph.edgeBegin(from); e < graph.edgeEnd(from); e++)
+    {
+        if (graph.edgeTarget(e) != to || (found && m.weights[e] >= m.weights[best])) continue;
+        best = e;
+        found = true;
+    }
+    return best;
+}
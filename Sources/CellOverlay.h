@@ -0,0 +1,183 @@
+#ifndef CELLOVERLAY_INCLUDED
+#define CELLOVERLAY_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CellOverlay.h
+
+// Customizable route planning: the map cut into nested cells, and for every
+// cell the cheapest way between each pair of its boundary nodes (those with
+// a segment leaving the cell).  Routing through a cell then takes one step
+// along this clique instead of searching inside it.
+//
+// The work comes in two parts.  The partition does not depend on what a
+// segment costs, and is built once: nodes are numbered along a Hilbert curve
+// when the map is loaded, so a run of consecutive ids is a compact patch of
+// the map, and a level-l cell is simply the ids that agree above bit
+// 7 + 3(l - 1) (128, 1024, 8192... nodes).  Levels are added until the top
+// one is down to a handful of cells, so their number grows with the log of
+// the map's size.  Customizing then works out the cliques for a given cost
+// of every edge, level by level: a level-1 cell by searching its own
+// segments, a higher one over the cliques of the cells inside it and the
+// segments between them.  The cells of one level are independent, so they
+// are customized side by side on a thread pool.  That is cheap enough to
+// redo whenever traffic changes.  Below the top level
+// each of those searches also leaves behind its tree, a parent for every
+// node it could reach in the cell, so turning a clique step back into
+// segments is a walk up the tree (and down into the cells below) rather
+// than another search.  The top level's cells are the biggest, and their
+// trees would cost the most, so a step there is unpacked by searching its
+// cell again, stopping at the step's far end.  A clique keeps, and stores,
+// only the arcs whose route passes no other boundary node of the cell; the
+// rest cost the same as two or more arcs it does keep.
+//
+// Costs come from the segment lengths, scaled or closed by a traffic file:
+//
+//   # start lat/lon, end lat/lon, then a factor or "closed"
+//   34.0625329 -118.4470263 34.0632405 -118.4470467 2.5
+//   34.0632405 -118.4470467 34.0640027 -118.4470710 closed
+//
+// A line gives the cost of the segment between two map coordinates as its
+// length times the factor, both ways, since the map's segments all go both
+// ways; a segment not in the file costs its length.  Because every cost is
+// the same both ways, so is the cheapest way between any two boundary nodes,
+// and a query searches from both ends over the same overlay: segments near
+// its two ends, and the cliques of the biggest cells holding neither end
+// everywhere else.
+//
+// A customization is a Metric held by a shared_ptr.  customize() swaps in a
+// new one when it is done, and a query keeps the one it started with, so
+// routers can go on searching while the traffic is applied.
+
+class ThreadPool;
+class SearchWorkspace;
+class SearchSide;
+
+const int OVERLAY_MAX_LEVELS = 9;       // cellBits(9) is 31: at most two cells of 32-bit ids
+const int OVERLAY_FIRST_CELL_BITS = 7;  // level-1 cells hold 2^7 node ids
+const int OVERLAY_CELL_BITS_STEP = 3;   // each level's cells hold 8 of the one below
+const uint32_t OVERLAY_TOP_CELLS = 16;  // levels are added until the top has no more cells than this
+
+class CellOverlay
+{
+public:
+      // the costs an overlay was customized with, and its cliques
+    struct Metric
+    {
+        std::vector<double> weights;                  // by edge; infinity if closed
+        double costPerMile;                           // the least weight per mile of length
+        // by level - 1, a row per boundary node (in the level's boundary
+        // order) of the arcs its clique keeps: their costs, and the
+        // boundary nodes they lead to by index in the cell
+        std::vector<double> cliques[OVERLAY_MAX_LEVELS];
+        std::vector<uint16_t> cliqueTargets[OVERLAY_MAX_LEVELS];
+        std::vector<uint32_t> cliqueRows[OVERLAY_MAX_LEVELS];  // [boundary + 1] where each row starts
+        // by level - 1 below the top, cell by cell, a tree per boundary
+        // node: parents by inner index
+        std::vector<uint16_t> trees[OVERLAY_MAX_LEVELS];
+    };
+
+    CellOverlay();
+      // partition graph, which must outlive this (or the next build/clear),
+      // and customize it with the segment lengths
+    void build(const StreetGraph& graph, ThreadPool* pool = nullptr);
+    void clear();
+    bool empty() const { return m_graph == nullptr; }
+    const StreetGraph& graph() const { return *m_graph; }
+
+      // the segment lengths, scaled by the traffic in file (see above);
+      // false, with "file:line: what went wrong" in error, if it cannot be read
+    bool readTraffic(const std::string& file, std::vector<double>& weights, std::string& error) const;
+      // work out the cliques for weights (one per edge, the same both ways)
+      // and make them the ones queries use
+    void customize(const std::vector<double>& weights, ThreadPool* pool = nullptr);
+      // the customization queries use now
+    std::shared_ptr<const Metric> metric() const;
+
+      // the cheapest route from start to end under metric m: its segments
+      // and what they cost; false if there is none
+    bool route(const Metric& m, NodeId start, NodeId end, SearchWorkspace& workspace,
+               std::vector<SegmentRef>& route, double& cost) const;
+
+    int levels() const { return m_levelCount; }
+      // the level-l cell (1 <= l <= levels()) holding n
+    uint32_t cell(int level, NodeId n) const { return n >> cellBits(level); }
+    uint32_t cellCount(int level) const { return (uint32_t)m_levels[level - 1].boundaryOffsets.size() - 1; }
+    size_t boundaryCount(int level) const { return m_levels[level - 1].boundary.size(); }
+      // bytes of the partition plus those of the current cliques, trees and weights
+    size_t memoryUsage() const;
+
+    CellOverlay(const CellOverlay&) = delete;
+    CellOverlay& operator=(const CellOverlay&) = delete;
+private:
+    struct Level
+    {
+        Level() : treeSize(0) {}
+        std::vector<uint32_t> boundaryOffsets;  // [cellCount + 1] into boundary
+        std::vector<NodeId>   boundary;         // the boundary nodes, cell by cell
+        std::vector<size_t>   treeOffsets;      // [cellCount] into a Metric's trees; empty at the top
+        size_t                treeSize;         // entries of a Metric's trees for the level
+        std::vector<uint32_t> position;         // by node: index among its cell's boundary, or NOT_BOUNDARY
+    };
+      // one step of a route over the overlay: to node, by an edge (level 0)
+      // or along the clique of a level-l cell
+    struct Step
+    {
+        NodeId from;
+        NodeId to;
+        int    level;
+        EdgeId edge;
+    };
+
+    const StreetGraph* m_graph;
+    int m_levelCount;
+    Level m_levels[OVERLAY_MAX_LEVELS];
+    std::vector<double> m_points;  // by node: x, y, z on a sphere the earth's size, in miles
+    mutable std::mutex m_metricLock;  // guards the pointer, not the Metric
+    std::shared_ptr<const Metric> m_metric;
+
+    static int cellBits(int level) { return OVERLAY_FIRST_CELL_BITS + OVERLAY_CELL_BITS_STEP * (level - 1); }
+    bool isBoundary(int level, NodeId n) const;
+      // Find the boundary of level l.  False, leaving the level empty, if
+      // its cells would outgrow the 16-bit indices of cliques and trees.
+    bool partition(int level);
+      // the straight line from a to b through the earth: never longer than
+      // distanceEarthMiles, and far cheaper, for the queries' estimates
+    double chordMiles(NodeId a, NodeId b) const;
+      // The inner nodes of a level-l cell are those a search in it can
+      // reach: all its nodes for level 1, else the boundary nodes of the
+      // cells one level down inside it.  Either way they are a run, of node
+      // ids or of the level below's boundary, so each has an index.
+    uint32_t innerCount(int level, uint32_t cell) const;
+    uint32_t innerIndex(int level, NodeId n) const;
+    NodeId innerNode(int level, uint32_t cell, uint32_t index) const;
+      // the overlay a query from start to end searches at n: the highest
+      // level whose cell of n holds neither, 0 (the segments) if none
+    int queryLevel(NodeId n, NodeId start, NodeId end) const;
+      // visit(to, cost, level, edge) for every arc leaving n on the
+      // level-l overlay: the clique of n's level-l cell and the edges out of
+      // that cell, or every edge for level 0.  Arcs leaving the cell within
+      // of level withinLevel are skipped (withinLevel 0: none are).
+    template<typename Visit>
+    void arcsFrom(const Metric& m, int level, NodeId n, int withinLevel, uint32_t within, Visit visit) const;
+      // Dijkstra on side from source inside the level-l cell holding it, over
+      // the overlay of level l - 1, until stop is settled (if it is a node)
+    void searchCell(const Metric& m, int level, NodeId source, SearchSide& side, NodeId stop = NO_NODE) const;
+      // the clique of one cell: its rows go to costs and targets, their
+      // lengths to m's cliqueRows (made offsets once the level is done)
+    void customizeCell(Metric& m, int level, uint32_t cell, SearchSide& side,
+                       std::vector<double>& costs, std::vector<uint16_t>& targets) const;
+      // append the segments a step stands for, following the trees, or at
+      // the top level searching the cell again on side
+    void unpack(const Metric& m, const Step& step, SearchSide& side, std::vector<SegmentRef>& route) const;
+      // the cheapest edge from one node to another
+    EdgeId edgeBetween(const Metric& m, NodeId from, NodeId to) const;
+};
+
+#endif // CELLOVERLAY_INCLUDED
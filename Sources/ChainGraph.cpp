@@ -0,0 +1,121 @@
+#include "ChainGraph.h"
+using namespace std;
+
+ChainGraph::ChainGraph()
+ : m_graph(nullptr), m_junctions(0)
+{
+}
+
+void ChainGraph::clear()
+{
+    m_graph = nullptr;
+    m_junctions = 0;
+    m_chainOffsets.clear();
+    m_chainTargets.clear();
+    m_chainLengths.clear();
+    m_stepOffsets.clear();
+    m_steps.clear();
+    m_through.clear();
+}
+
+NodeId ChainGraph::walk(NodeId from, EdgeId e, const vector<char>& interior, vector<char>& seen, bool record)
+{
+    const StreetGraph& g = *m_graph;
+    ChainId chain = (ChainId)m_chainTargets.size();
+    double length = g.edgeLength(e);
+    NodeId prev = from;
+    NodeId cur = g.edgeTarget(e);
+    if (record)
+    {
+        Step first = { from, e };
+        m_steps.push_back(first);
+    }
+    while (interior[cur])
+    {
+        seen[cur] = true;
+        // an interior node has two edges, to different nodes; take the one
+        // that does not lead back
+        EdgeId next = g.edgeBegin(cur);
+        if (g.edgeTarget(next) == prev) next++;
+        if (record)
+        {
+            Through t = { chain, (uint32_t)m_steps.size() };
+            m_through[2 * cur + (m_through[2 * cur].chain != NO_NODE)] = t;
+            Step step = { cur, next };
+            m_steps.push_back(step);
+        }
+        length += g.edgeLength(next);
+        prev = cur;
+        cur = g.edgeTarget(next);
+    }
+    if (record)
+    {
+        m_chainTargets.push_back(cur);
+        m_chainLengths.push_back(length);
+        m_stepOffsets.push_back((uint32_t)m_steps.size());
+    }
+    return cur;
+}
+
+void ChainGraph::build(const StreetGraph& graph)
+{
+    clear();
+    m_graph = &graph;
+    uint32_t n = graph.nodeCount();
+
+    // who enters each node: a count, and the first two sources
+    vector<uint32_t> inCount(n, 0);
+    vector<NodeId> inFrom(2 * n, NO_NODE);
+    for (NodeId v = 0; v < n; v++)
+    {
+        for (EdgeId e = graph.edgeBegin(v); e < graph.edgeEnd(v); e++)
+        {
+            NodeId to = graph.edgeTarget(e);
+            if (inCount[to] < 2) inFrom[2 * to + inCount[to]] = v;
+            inCount[to]++;
+        }
+    }
+
+    // interior: leaves to exactly two other nodes, and is entered from exactly those two
+    vector<char> interior(n, false);
+    for (NodeId v = 0; v < n; v++)
+    {
+        if (graph.edgeEnd(v) - graph.edgeBegin(v) != 2 || inCount[v] != 2) continue;
+        NodeId a = graph.edgeTarget(graph.edgeBegin(v));
+        NodeId b = graph.edgeTarget(graph.edgeBegin(v) + 1);
+        if (a == b || a == v || b == v) continue;
+        interior[v] = (inFrom[2 * v] == a && inFrom[2 * v + 1] == b) || (inFrom[2 * v] == b && inFrom[2 * v + 1] == a);
+    }
+
+    // A ring of interior nodes (a closed loop touching nothing else) cannot
+    // be reached from any junction; make one node of each ring a junction.
+    vector<char> seen(n, false);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (NodeId v = 0; v < n; v++)
+        {
+            if (pass == 1 && interior[v] && !seen[v])
+                interior[v] = false; // first node of an unreached ring
+            if (interior[v] || (pass == 1 && seen[v])) continue;
+            seen[v] = true;
+            for (EdgeId e = graph.edgeBegin(v); e < graph.edgeEnd(v); e++)
+                walk(v, e, interior, seen, false);
+        }
+    }
+
+    // the chains, in CSR order by junction
+    Through none = { NO_NODE, 0 };
+    m_through.assign(2 * n, none);
+    m_chainOffsets.assign(n + 1, 0);
+    m_stepOffsets.assign(1, 0);
+    for (NodeId v = 0; v < n; v++)
+    {
+        if (!interior[v])
+        {
+            m_junctions++;
+            for (EdgeId e = graph.edgeBegin(v); e < graph.edgeEnd(v); e++)
+                walk(v, e, interior, seen, true);
+        }
+        m_chainOffsets[v + 1] = (ChainId)m_chainTargets.size();
+    }
+}
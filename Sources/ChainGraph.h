@@ -0,0 +1,85 @@
+#ifndef CHAINGRAPH_INCLUDED
+#define CHAINGRAPH_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ChainGraph.h
+
+// A StreetGraph with its degree-2 chains collapsed.  A node is interior when
+// it has exactly two neighbors and can be entered and left towards both of
+// them, like the middle points of a street drawn with many segments; every
+// other node is a junction.  Walking from a junction along one of its
+// segments through interior nodes until the next junction gives a chain, and
+// the chains become the only edges a search has to look at.  Each chain keeps
+// the original segments it replaced, in order, so routes over chains unpack to
+// exactly the segments a search of the full graph would report.
+//
+// Node ids are those of the StreetGraph; interior nodes simply have no
+// chains.  For a search that starts or ends at an interior node, through()
+// tells which two chains (one per direction) run through it and where.
+
+typedef uint32_t ChainId;
+
+class ChainGraph
+{
+public:
+      // one original segment of a chain
+    struct Step
+    {
+        NodeId from;
+        EdgeId edge;
+    };
+      // a chain running through an interior node: segments [first, at) of
+      // the flat step array lead up to the node, [at, last) lead on from it
+    struct Through
+    {
+        ChainId chain;
+        uint32_t at;
+    };
+
+    ChainGraph();
+      // contract graph, which must outlive this (or the next build/clear)
+    void build(const StreetGraph& graph);
+    void clear();
+    bool empty() const { return m_graph == nullptr; }
+    const StreetGraph& graph() const { return *m_graph; }
+
+    bool isJunction(NodeId n) const { return m_through[2 * n].chain == NO_NODE; }
+    uint32_t junctionCount() const { return m_junctions; }
+    uint32_t chainCount() const { return (uint32_t)m_chainTargets.size(); }
+
+      // chains leaving junction n are [chainBegin(n), chainEnd(n))
+    ChainId chainBegin(NodeId n) const { return m_chainOffsets[n]; }
+    ChainId chainEnd(NodeId n) const { return m_chainOffsets[n + 1]; }
+    NodeId chainTarget(ChainId c) const { return m_chainTargets[c]; }
+    double chainLength(ChainId c) const { return m_chainLengths[c]; }
+      // the original segments of chain c are steps [firstStep(c), lastStep(c))
+    uint32_t firstStep(ChainId c) const { return m_stepOffsets[c]; }
+    uint32_t lastStep(ChainId c) const { return m_stepOffsets[c + 1]; }
+    const Step& step(uint32_t i) const { return m_steps[i]; }
+    SegmentRef segment(uint32_t i) const { return SegmentRef(m_graph, m_steps[i].from, m_steps[i].edge); }
+
+      // the two chains through interior node n (chain NO_NODE for a junction)
+    const Through& through(NodeId n, int which) const { return m_through[2 * n + which]; }
+
+    ChainGraph(const ChainGraph&) = delete;
+    ChainGraph& operator=(const ChainGraph&) = delete;
+private:
+    const StreetGraph*    m_graph;
+    uint32_t              m_junctions;
+    std::vector<ChainId>  m_chainOffsets;  // [nodeCount + 1]
+    std::vector<NodeId>   m_chainTargets;  // [chainCount]
+    std::vector<double>   m_chainLengths;
+    std::vector<uint32_t> m_stepOffsets;   // [chainCount + 1]
+    std::vector<Step>     m_steps;
+    std::vector<Through>  m_through;       // [2 * nodeCount]
+
+      // follow edge e out of junction from through interior nodes to the next
+      // junction; with record, append the steps and note every node passed
+    NodeId walk(NodeId from, EdgeId e, const std::vector<char>& interior, std::vector<char>& seen, bool record);
+};
+
+#endif // CHAINGRAPH_INCLUDED
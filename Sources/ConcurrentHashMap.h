@@ -0,0 +1,116 @@
+#ifndef CONCURRENTHASHMAP_INCLUDED
+#define CONCURRENTHASHMAP_INCLUDED
+
+#include "ExpandableHashMap.h"
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+// ConcurrentHashMap.h
+
+// A hash map many threads can use at once, for state shared between planners
+// (snapped coordinates, memoized routes).  Keys are spread over a power of
+// two of shards by their hasher() value; each shard is an ordinary map behind
+// its own reader/writer lock, so lookups never wait for each other and an
+// associate only blocks the one shard it touches.  Shards sit on separate
+// cache lines so threads working on neighboring shards do not slow each other.
+//
+// A pointer into a shard would not survive another thread's associate, so
+// find copies the value out instead of returning a pointer.
+
+const int CONCURRENT_DEFAULT_SHARDS = 64;
+
+template<typename KeyType, typename ValueType, typename Map = ExpandableHashMap<KeyType, ValueType>>
+class ConcurrentHashMap
+{
+public:
+	ConcurrentHashMap(int shards = CONCURRENT_DEFAULT_SHARDS);
+	void reset();
+	int size() const;
+	void associate(const KeyType& key, const ValueType& value);
+
+	  // copy the value for key into value; false if key is not in the map
+	bool find(const KeyType& key, ValueType& value) const;
+
+	ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+	ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+private:
+    struct Shard
+    {
+        mutable std::shared_timed_mutex lock;
+        Map map;
+        char padding[64];  // keep the next shard's lock off this cache line
+    };
+
+    std::vector<Shard> m_shards;
+    unsigned int m_shardBits;
+
+    Shard& shardFor(const KeyType& key) const;
+};
+
+template<typename KeyType, typename ValueType, typename Map>
+ConcurrentHashMap<KeyType, ValueType, Map>::ConcurrentHashMap(int shards)
+ : m_shardBits(0)
+{
+    while ((1 << m_shardBits) < shards && m_shardBits < 16)
+        m_shardBits++;
+    m_shards = std::vector<Shard>((size_t)1 << m_shardBits);
+}
+
+template<typename KeyType, typename ValueType, typename Map>
+void ConcurrentHashMap<KeyType, ValueType, Map>::reset()
+{
+    for (Shard& shard : m_shards)
+    {
+        std::unique_lock<std::shared_timed_mutex> hold(shard.lock);
+        shard.map.reset();
+    }
+}
+
+template<typename KeyType, typename ValueType, typename Map>
+int ConcurrentHashMap<KeyType, ValueType, Map>::size() const
+{
+    int total = 0;
+    for (const Shard& shard : m_shards)
+    {
+        std::shared_lock<std::shared_timed_mutex> hold(shard.lock);
+        total += shard.map.size();
+    }
+    return total;
+}
+
+template<typename KeyType, typename ValueType, typename Map>
+void ConcurrentHashMap<KeyType, ValueType, Map>::associate(const KeyType& key, const ValueType& value)
+{
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::shared_timed_mutex> hold(shard.lock);
+    shard.map.associate(key, value);
+}
+
+template<typename KeyType, typename ValueType, typename Map>
+bool ConcurrentHashMap<KeyType, ValueType, Map>::find(const KeyType& key, ValueType& value) const
+{
+    const Shard& shard = shardFor(key);
+    std::shared_lock<std::shared_timed_mutex> hold(shard.lock);
+    const ValueType* found = static_cast<const Map&>(shard.map).find(key);
+    if (found == nullptr) return false;
+    value = *found;
+    return true;
+}
+
+// PRIVATE MEMBER FUNCTIONS
+
+template<typename KeyType, typename ValueType, typename Map>
+typename ConcurrentHashMap<KeyType, ValueType, Map>::Shard& ConcurrentHashMap<KeyType, ValueType, Map>::shardFor(const KeyType& key) const
+{
+    unsigned int hasher(const KeyType& k);
+    // the shard maps pick buckets by the low bits of the same hash, so take
+    // the shard from the high bits of a multiplicative scramble of it
+    unsigned int scrambled = (unsigned int)(hasher(key) * 2654435761u);
+    size_t shard = m_shardBits == 0 ? 0 : scrambled >> (32 - m_shardBits);
+    return const_cast<Shard&>(m_shards[shard]);
+}
+
+#endif // CONCURRENTHASHMAP_INCLUDED
@@ -0,0 +1,376 @@
+#include "ContractionHierarchy.h"
+#include "IndexedHeap.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+using namespace std;
+
+  // a witness search gives up after settling this many nodes, and the
+  // shortcut it was checking is added just in case
+const int WITNESS_SETTLE_LIMIT = 500;
+
+  // FNV-1a over the edge layout: enough to tell another map, or the same map
+  // with its nodes in another order, from the one a hierarchy was built for
+static uint32_t graphChecksum(const StreetGraph& graph)
+{
+    uint32_t h = 2166136261u;
+    auto mix = [&h](uint32_t x) {
+        for (int i = 0; i < 4; i++, x >>= 8)
+            h = (h ^ (x & 0xFF)) * 16777619u;
+    };
+    for (NodeId n = 0; n <= graph.nodeCount(); n++)
+        mix(n < graph.nodeCount() ? graph.edgeBegin(n) : graph.edgeCount());
+    for (EdgeId e = 0; e < graph.edgeCount(); e++)
+        mix(graph.edgeTarget(e));
+    return h;
+}
+
+  // The working state of a build: the graph of the nodes not yet contracted,
+  // as adjacency lists holding each undirected edge at both ends.
+class HierarchyBuilder
+{
+public:
+    typedef ContractionHierarchy::Arc Arc;
+
+    HierarchyBuilder(const StreetGraph& graph);
+      // contract every node, giving each its rank and its arcs (which lead to higher ranks)
+    void run(vector<uint32_t>& ranks, vector<vector<Arc>>& arcs);
+private:
+    struct WorkArc
+    {
+        NodeId to;
+        NodeId middle;  // NO_NODE for a segment
+        EdgeId edge;    // for a segment: the graph edge towards to
+        double length;
+    };
+    struct Shortcut
+    {
+        NodeId from;
+        NodeId to;
+        double length;
+    };
+
+    const StreetGraph&      m_graph;
+    vector<vector<WorkArc>> m_adjacent;          // by node, only neighbors not yet contracted
+    vector<uint32_t>        m_deletedNeighbors;  // neighbors already contracted
+    vector<Shortcut>        m_shortcuts;         // needed by the node last looked at
+    vector<double>          m_distance;          // of the witness search; infinity if untouched
+    vector<NodeId>          m_touched;
+    IndexedHeap             m_witnessOpen;
+
+    static void addOrImprove(vector<WorkArc>& arcs, const WorkArc& a);
+      // fill m_shortcuts with what contracting v would need
+    void findShortcuts(NodeId v);
+      // how much contracting v now would cost; lower goes first
+    double priority(NodeId v);
+      // shortest distances from source not through avoid, as far as limit
+    void witnessSearch(NodeId source, NodeId avoid, double limit);
+};
+
+HierarchyBuilder::HierarchyBuilder(const StreetGraph& graph)
+ : m_graph(graph), m_adjacent(graph.nodeCount()), m_deletedNeighbors(graph.nodeCount(), 0),
+   m_distance(graph.nodeCount(), numeric_limits<double>::infinity())
+{
+    for (NodeId n = 0; n < graph.nodeCount(); n++)
+    {
+        for (EdgeId e = graph.edgeBegin(n); e < graph.edgeEnd(n); e++)
+        {
+            if (graph.edgeTarget(e) == n) continue; // a loop never shortens anything
+            WorkArc a = { graph.edgeTarget(e), NO_NODE, e, graph.edgeLength(e) };
+            addOrImprove(m_adjacent[n], a);
+        }
+    }
+    m_witnessOpen.reset(graph.nodeCount());
+}
+
+void HierarchyBuilder::addOrImprove(vector<WorkArc>& arcs, const WorkArc& a)
+{
+    for (WorkArc& existing : arcs)
+    {
+        if (existing.to != a.to) continue;
+        if (a.length < existing.length) // parallel segments: keep the first of the shortest
+            existing = a;
+        return;
+    }
+    arcs.push_back(a);
+}
+
+void HierarchyBuilder::witnessSearch(NodeId source, NodeId avoid, double limit)
+{
+    for (NodeId n : m_touched)
+        m_distance[n] = numeric_limits<double>::infinity();
+    m_touched.clear();
+    m_witnessOpen.clear();
+    m_distance[source] = 0;
+    m_touched.push_back(source);
+    m_witnessOpen.pushOrDecrease(source, 0);
+    for (int settled = 0; !m_witnessOpen.empty() && settled < WITNESS_SETTLE_LIMIT; settled++)
+    {
+        if (m_witnessOpen.topKey() > limit) break;
+        NodeId curr = m_witnessOpen.pop();
+        for (const WorkArc& a : m_adjacent[curr])
+        {
+            if (a.to == avoid) continue;
+            double distance = m_distance[curr] + a.length;
+            if (distance >= m_distance[a.to]) continue;
+            if (m_distance[a.to] == numeric_limits<double>::infinity())
+                m_touched.push_back(a.to);
+            m_distance[a.to] = distance;
+            m_witnessOpen.pushOrDecrease(a.to, distance);
+        }
+    }
+}
+
+void HierarchyBuilder::findShortcuts(NodeId v)
+{
+    // the way from one neighbor of v through v to another needs a shortcut
+    // unless the witness search finds another that is no longer; every edge
+    // is undirected, so each pair is checked once
+    m_shortcuts.clear();
+    const vector<WorkArc>& around = m_adjacent[v];
+    for (size_t i = 0; i + 1 < around.size(); i++)
+    {
+        double limit = 0;
+        for (size_t j = i + 1; j < around.size(); j++)
+            limit = max(limit, around[i].length + around[j].length);
+        witnessSearch(around[i].to, v, limit);
+        for (size_t j = i + 1; j < around.size(); j++)
+        {
+            double via = around[i].length + around[j].length;
+            if (m_distance[around[j].to] > via)
+            {
+                Shortcut s = { around[i].to, around[j].to, via };
+                m_shortcuts.push_back(s);
+            }
+        }
+    }
+}
+
+double HierarchyBuilder::priority(NodeId v)
+{
+    // the edge difference (shortcuts added less edges removed) keeps the
+    // remaining graph sparse, and counting neighbors already contracted
+    // spreads contraction evenly over the map
+    findShortcuts(v);
+    return (double)m_shortcuts.size() - (double)m_adjacent[v].size() + m_deletedNeighbors[v];
+}
+
+void HierarchyBuilder::run(vector<uint32_t>& ranks, vector<vector<Arc>>& arcs)
+{
+    uint32_t n = m_graph.nodeCount();
+    ranks.assign(n, 0);
+    arcs.assign(n, vector<Arc>());
+    IndexedHeap order;
+    order.reset(n);
+    for (NodeId v = 0; v < n; v++)
+        order.pushOrDecrease(v, priority(v));
+
+    uint32_t next = 0;
+    while (!order.empty())
+    {
+        // priorities go stale as the graph shrinks; recheck the cheapest
+        // and put it back if it is no longer the cheapest
+        NodeId v = order.pop();
+        double p = priority(v); // leaves v's shortcuts in m_shortcuts
+        if (!order.empty() && p > order.topKey())
+        {
+            order.pushOrDecrease(v, p);
+            continue;
+        }
+
+        ranks[v] = next++;
+        for (const WorkArc& a : m_adjacent[v])
+        {
+            Arc arc = { a.to, a.middle, a.edge, NO_NODE, a.length };
+            vector<WorkArc>& back = m_adjacent[a.to];
+            for (size_t i = 0; i < back.size(); i++)
+            {
+                if (back[i].to != v) continue;
+                arc.reverseEdge = back[i].edge;
+                back[i] = back.back();
+                back.pop_back();
+                break;
+            }
+            arcs[v].push_back(arc);
+            m_deletedNeighbors[a.to]++;
+        }
+        for (const Shortcut& s : m_shortcuts)
+        {
+            WorkArc forward = { s.to, v, NO_NODE, s.length };
+            WorkArc backward = { s.from, v, NO_NODE, s.length };
+            addOrImprove(m_adjacent[s.from], forward);
+            addOrImprove(m_adjacent[s.to], backward);
+        }
+        vector<WorkArc>().swap(m_adjacent[v]);
+        for (const Arc& a : arcs[v])
+            order.pushOrUpdate(a.target, priority(a.target));
+    }
+}
+
+//******************** ContractionHierarchy functions *************************
+
+ContractionHierarchy::ContractionHierarchy()
+ : m_graph(nullptr), m_shortcuts(0)
+{
+}
+
+void ContractionHierarchy::clear()
+{
+    m_graph = nullptr;
+    m_shortcuts = 0;
+    m_ranks.clear();
+    m_arcOffsets.clear();
+    m_arcs.clear();
+}
+
+void ContractionHierarchy::build(const StreetGraph& graph)
+{
+    clear();
+    vector<vector<Arc>> arcs;
+    {
+        HierarchyBuilder builder(graph);
+        builder.run(m_ranks, arcs);
+    }
+    m_arcOffsets.reserve(graph.nodeCount() + 1);
+    m_arcOffsets.push_back(0);
+    for (vector<Arc>& nodeArcs : arcs)
+    {
+        m_arcs.insert(m_arcs.end(), nodeArcs.begin(), nodeArcs.end());
+        m_arcOffsets.push_back((uint32_t)m_arcs.size());
+        vector<Arc>().swap(nodeArcs);
+    }
+    for (const Arc& a : m_arcs)
+        m_shortcuts += a.middle != NO_NODE;
+    m_graph = &graph;
+}
+
+size_t ContractionHierarchy::memoryUsage() const
+{
+    return m_ranks.size() * sizeof(uint32_t) + m_arcOffsets.size() * sizeof(uint32_t) + m_arcs.size() * sizeof(Arc);
+}
+
+uint32_t ContractionHierarchy::findArc(NodeId from, NodeId to) const
+{
+    uint32_t i = arcBegin(from);
+    while (i < arcEnd(from) && m_arcs[i].target != to)
+        i++;
+    return i;
+}
+
+void ContractionHierarchy::unpack(NodeId from, uint32_t i, bool reversed, vector<SegmentRef>& route) const
+{
+    const Arc& a = m_arcs[i];
+    if (a.middle == NO_NODE)
+    {
+        if (reversed)
+            route.push_back(SegmentRef(m_graph, a.target, a.reverseEdge));
+        else
+            route.push_back(SegmentRef(m_graph, from, a.edge));
+        return;
+    }
+    // the middle node was contracted before both ends, so it holds the arcs
+    // to them (load checks that it does)
+    uint32_t toFrom = findArc(a.middle, from);
+    uint32_t toTarget = findArc(a.middle, a.target);
+    if (reversed)
+    {
+        unpack(a.middle, toTarget, true, route);
+        unpack(a.middle, toFrom, false, route);
+    }
+    else
+    {
+        unpack(a.middle, toFrom, true, route);
+        unpack(a.middle, toTarget, false, route);
+    }
+}
+
+bool ContractionHierarchy::save(const string& file) const
+{
+    if (empty()) return false;
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HIERARCHY_MAGIC, sizeof(header.magic));
+    header.version = HIERARCHY_VERSION;
+    header.nodeCount = m_graph->nodeCount();
+    header.edgeCount = m_graph->edgeCount();
+    header.arcCount = arcCount();
+    header.shortcutCount = m_shortcuts;
+    header.graphChecksum = graphChecksum(*m_graph);
+
+    // written beside the target and renamed over it, so a failed save
+    // leaves the previous hierarchy in place
+    string tempFile = file + ".tmp";
+    ofstream out(tempFile, ios::binary | ios::trunc);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_ranks.data()), m_ranks.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(m_arcOffsets.data()), m_arcOffsets.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(m_arcs.data()), m_arcs.size() * sizeof(Arc));
+    out.close();
+    if (!out || rename(tempFile.c_str(), file.c_str()) != 0)
+    {
+        remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ContractionHierarchy::load(const string& file, const StreetGraph& graph)
+{
+    clear();
+    ifstream in(file, ios::binary);
+    Header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (memcmp(header.magic, HIERARCHY_MAGIC, sizeof(header.magic)) != 0 || header.version != HIERARCHY_VERSION
+        || header.nodeCount != graph.nodeCount() || header.edgeCount != graph.edgeCount()
+        || header.graphChecksum != graphChecksum(graph))
+        return false;
+    // the arrays must fill the rest of the file exactly, before arcCount is trusted with an allocation
+    in.seekg(0, ios::end);
+    uint64_t expected = sizeof(header) + (2 * uint64_t(header.nodeCount) + 1) * sizeof(uint32_t) +
+                        uint64_t(header.arcCount) * sizeof(Arc);
+    if (!in || uint64_t(in.tellg()) != expected) return false;
+    in.seekg(sizeof(header));
+    m_ranks.resize(header.nodeCount);
+    m_arcOffsets.resize(header.nodeCount + 1);
+    m_arcs.resize(header.arcCount);
+    in.read(reinterpret_cast<char*>(m_ranks.data()), m_ranks.size() * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(m_arcOffsets.data()), m_arcOffsets.size() * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(m_arcs.data()), m_arcs.size() * sizeof(Arc));
+
+    // check everything a query or unpack will follow, so a damaged file
+    // is rejected here instead of sending a search out of bounds: the ranks
+    // a permutation, the offsets in order, every arc leading upwards, and
+    // every shortcut's middle holding arcs to both its ends
+    bool ok = bool(in) && m_arcOffsets[0] == 0 && m_arcOffsets[header.nodeCount] == header.arcCount;
+    vector<bool> ranked(header.nodeCount);
+    for (NodeId n = 0; ok && n < header.nodeCount; n++)
+    {
+        ok = m_ranks[n] < header.nodeCount && !ranked[m_ranks[n]] && m_arcOffsets[n] <= m_arcOffsets[n + 1];
+        if (ok)
+            ranked[m_ranks[n]] = true;
+    }
+    for (NodeId n = 0; ok && n < header.nodeCount; n++)
+    {
+        for (uint32_t i = m_arcOffsets[n]; ok && i < m_arcOffsets[n + 1]; i++)
+        {
+            const Arc& a = m_arcs[i];
+            ok = a.target < header.nodeCount && m_ranks[a.target] > m_ranks[n];
+            if (ok && a.middle == NO_NODE)
+                ok = a.edge < header.edgeCount && a.reverseEdge < header.edgeCount;
+            else if (ok)
+                ok = a.middle < header.nodeCount && m_ranks[a.middle] < m_ranks[n]
+                    && findArc(a.middle, n) != arcEnd(a.middle) && findArc(a.middle, a.target) != arcEnd(a.middle);
+        }
+    }
+    if (!ok)
+    {
+        clear();
+        return false;
+    }
+    m_shortcuts = header.shortcutCount;
+    m_graph = &graph;
+    return true;
+}
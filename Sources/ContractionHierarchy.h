@@ -0,0 +1,96 @@
+#ifndef CONTRACTIONHIERARCHY_INCLUDED
+#define CONTRACTIONHIERARCHY_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ContractionHierarchy.h
+
+// A contraction hierarchy over a StreetGraph.  Nodes are contracted one at a
+// time, least important first (by how many shortcuts removing them would add,
+// and how many of their neighbors are already gone).  Contracting a node adds
+// a shortcut between two of its remaining neighbors whenever the way through
+// it is the only shortest one, found by a small witness search.  Each node
+// keeps the arcs to the neighbors it still had when it was contracted, all of
+// which rank above it; a shortest route always climbs these arcs from both
+// ends and meets at its highest node, so a query only searches upwards from
+// start and end and settles a few hundred nodes at most.
+//
+// The parser adds every segment in both directions with the same length, so
+// the hierarchy is undirected: one arc serves both ways, and knows the graph
+// edge for each.  A shortcut remembers the node it bypassed, whose own arcs
+// to the shortcut's two ends are what unpack() expands it into.
+//
+// Node ids are those of the StreetGraph.  save() writes the hierarchy to a
+// file that load() accepts only for the same graph (same node and edge counts
+// and edge layout), so a map and its hierarchy are built and loaded in pairs.
+
+const char HIERARCHY_MAGIC[8] = { 'F', 'D', 'M', 'A', 'P', 'C', 'H', 'Y' };
+const uint32_t HIERARCHY_VERSION = 1;
+
+class ContractionHierarchy
+{
+public:
+      // an arc from a node to one contracted after it
+    struct Arc
+    {
+        NodeId target;
+        NodeId middle;       // the node a shortcut bypasses; NO_NODE for a segment
+        EdgeId edge;         // for a segment: the graph edge to target,
+        EdgeId reverseEdge;  //   and the one back from target
+        double length;
+    };
+
+    ContractionHierarchy();
+      // contract graph, which must outlive this (or the next build/load/clear)
+    void build(const StreetGraph& graph);
+    bool save(const std::string& file) const;
+      // read a hierarchy saved for graph; false (and empty) if it is not one
+    bool load(const std::string& file, const StreetGraph& graph);
+    void clear();
+    bool empty() const { return m_graph == nullptr; }
+    const StreetGraph& graph() const { return *m_graph; }
+
+      // position in the contraction order: arcs always lead to higher ranks
+    uint32_t rank(NodeId n) const { return m_ranks[n]; }
+      // arcs of node n are [arcBegin(n), arcEnd(n))
+    uint32_t arcBegin(NodeId n) const { return m_arcOffsets[n]; }
+    uint32_t arcEnd(NodeId n) const { return m_arcOffsets[n + 1]; }
+    const Arc& arc(uint32_t i) const { return m_arcs[i]; }
+    uint32_t arcCount() const { return (uint32_t)m_arcs.size(); }
+    uint32_t shortcutCount() const { return m_shortcuts; }
+      // bytes taken by the hierarchy's arrays
+    size_t memoryUsage() const;
+
+      // append the segments arc i of node from stands for, walked from from
+      // to the arc's target, or with reversed from the target to from
+    void unpack(NodeId from, uint32_t i, bool reversed, std::vector<SegmentRef>& route) const;
+
+    ContractionHierarchy(const ContractionHierarchy&) = delete;
+    ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+private:
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t nodeCount;
+        uint32_t edgeCount;
+        uint32_t arcCount;
+        uint32_t shortcutCount;
+        uint32_t graphChecksum;
+    };
+
+    const StreetGraph*    m_graph;
+    uint32_t              m_shortcuts;
+    std::vector<uint32_t> m_ranks;       // [nodeCount]
+    std::vector<uint32_t> m_arcOffsets;  // [nodeCount + 1]
+    std::vector<Arc>      m_arcs;
+
+      // the arc of from leading to to, or arcEnd(from) if it has none
+    uint32_t findArc(NodeId from, NodeId to) const;
+};
+
+#endif // CONTRACTIONHIERARCHY_INCLUDED
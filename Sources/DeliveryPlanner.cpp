@@ -1,5 +1,9 @@
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "RouteCache.h"
+#include "SearchWorkspace.h"
+#include "StreetGraph.h"
+#include "ThreadPool.h"
+#include <memory>
 #include <vector>
 #include <list>
 #include <cmath>
@@ -39,11 +43,22 @@ public:
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+    void setRouteCache(RouteCache* cache) { m_cache = cache; }
+    void setThreadPool(ThreadPool* pool) { m_pool = pool; }
 private:
     const StreetMap* m_map;
+    RouteCache* m_cache; // shared with other planners, may be nullptr
+    ThreadPool* m_pool;  // routes the legs of a plan side by side, may be nullptr
+
+      // route one leg in workspace, through the cache if there is one
+    DeliveryResult routeLeg(const PointToPointRouter& router, SearchWorkspace& workspace, const GeoCoord& from,
+                            const GeoCoord& to, vector<SegmentRef>& route, double& distance) const;
+      // route stops[i] to stops[i + 1] for every i, on the pool if there is one
+    void routeLegs(const vector<GeoCoord>& stops, vector<vector<SegmentRef>>& routes,
+                   vector<double>& distances, vector<DeliveryResult>& results) const;
 };
 
-DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm) : m_map(sm)
+DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm) : m_map(sm), m_cache(nullptr), m_pool(nullptr)
 {
 }
 
@@ -51,35 +66,90 @@ DeliveryPlannerImpl::~DeliveryPlannerImpl()
 {
 }
 
+DeliveryResult DeliveryPlannerImpl::routeLeg(const PointToPointRouter& router, SearchWorkspace& workspace, const GeoCoord& from,
+                                             const GeoCoord& to, vector<SegmentRef>& route, double& distance) const
+{
+    if (m_cache == nullptr)
+        return router.generatePointToPointRoute(from, to, route, distance, workspace);
+    const StreetGraph& graph = m_map->graph();
+    NodeId start = graph.findNode(from);
+    NodeId end = graph.findNode(to);
+    if (start == NO_NODE || end == NO_NODE) // not worth keeping
+        return router.generatePointToPointRoute(from, to, route, distance, workspace);
+    DeliveryResult result;
+    if (m_cache->find(start, end, route, distance, result))
+        return result;
+    unsigned long generation = m_map->generation(); // before routing: traffic may change while it runs
+    result = router.generatePointToPointRoute(from, to, route, distance, workspace);
+    m_cache->store(start, end, route, distance, result, generation);
+    return result;
+}
+
+void DeliveryPlannerImpl::routeLegs(const vector<GeoCoord>& stops, vector<vector<SegmentRef>>& routes,
+                                    vector<double>& distances, vector<DeliveryResult>& results) const
+{
+    size_t legs = stops.size() - 1;
+    routes.assign(legs, vector<SegmentRef>());
+    distances.assign(legs, 0);
+    results.assign(legs, DELIVERY_SUCCESS);
+    PointToPointRouter ppr(m_map); // create a new pointtopointrouter class
+    if (m_pool == nullptr)
+    {
+        SearchWorkspace workspace;
+        for (size_t i = 0; i < legs; i++)
+        {
+            results[i] = routeLeg(ppr, workspace, stops[i], stops[i + 1], routes[i], distances[i]);
+            if (results[i] != DELIVERY_SUCCESS) return; // the plan stops here anyway
+        }
+        return;
+    }
+    // one router for all, searching in a workspace per thread; each leg
+    // writes only its own slots, and the cache has its own lock
+    vector<unique_ptr<SearchWorkspace>> workspaces(m_pool->threadCount());
+    m_pool->parallelFor(legs, [&](size_t i, unsigned int thread) {
+        if (workspaces[thread] == nullptr)
+            workspaces[thread].reset(new SearchWorkspace);
+        results[i] = routeLeg(ppr, *workspaces[thread], stops[i], stops[i + 1], routes[i], distances[i]);
+    });
+}
+
 DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    PointToPointRouter ppr(m_map); // create a new pointtopointrouter class
     DeliveryOptimizer dopt(m_map); // create a new delivery optimizer class
     vector<DeliveryRequest> optimizedDeliveries;
     optimizedDeliveries = deliveries;
     double oldCrowDistance, newCrowDistance;
     dopt.optimizeDeliveryOrder(depot, optimizedDeliveries, oldCrowDistance, newCrowDistance);
 
-    list<StreetSegment> segRoute; // input for ppr
-    double distance; // input for ppr
-    
-    GeoCoord prev = depot; // holds previous destination coordinate (starts at depot)
+    // every leg is routed up front (they do not depend on one another), then
+    // turned into commands in order
+    vector<GeoCoord> stops(1, depot);
+    for (const DeliveryRequest& request : optimizedDeliveries)
+        stops.push_back(request.location);
+    stops.push_back(depot);
+    vector<vector<SegmentRef>> legRoutes; // viewed in place in the map
+    vector<double> legDistances;
+    vector<DeliveryResult> legResults;
+    routeLegs(stops, legRoutes, legDistances, legResults);
+
+    size_t leg = 0;
     auto it = optimizedDeliveries.begin();
     while(it != optimizedDeliveries.end())
     {
-        DeliveryResult destRoute = ppr.generatePointToPointRoute(prev, (*it).location, segRoute, distance);
+        DeliveryResult destRoute = legResults[leg];
         if (destRoute != DELIVERY_SUCCESS) return destRoute; // if point router doesn't get route, return!
-        totalDistanceTravelled += distance;
-        StreetSegment previousSegment;
+        totalDistanceTravelled += legDistances[leg];
+        const vector<SegmentRef>& segRoute = legRoutes[leg];
+        SegmentRef previousSegment;
         auto segIt = segRoute.begin(); // iterate the destination route
         while (segIt != segRoute.end())
         {
             DeliveryCommand newCommand;
-            string streetName = (*segIt).name; // maintain streetname
+            uint32_t streetName = segIt->nameId(); // maintain streetname
             double commandDistance = 0;
             // FIX THIS BC WRONG DIRECTION
             double angle = angleOfLine(*segIt);
@@ -89,43 +159,45 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
                 if (diffAngle >= 1 && diffAngle < 180)
                 {
                     DeliveryCommand turnCommand;
-                    turnCommand.initAsTurnCommand("left", segIt->name);
+                    turnCommand.initAsTurnCommand("left", segIt->name());
                     commands.push_back(turnCommand);
                 }
                 else if (diffAngle >= 180 && diffAngle <= 359)
                 {
                     DeliveryCommand turnCommand;
-                    turnCommand.initAsTurnCommand("right", segIt->name);
+                    turnCommand.initAsTurnCommand("right", segIt->name());
                     commands.push_back(turnCommand);
                 }
             }
             previousSegment = *segIt;
-            while ((*segIt).name == streetName)
+            const char* name = segIt->name();
+            while (segIt != segRoute.end() && segIt->nameId() == streetName)
             {
-                commandDistance += distanceEarthMiles(segIt->start, segIt->end);
+                commandDistance += segIt->length();
                 segIt++;
             }
             string direction = getDirection(angle);
-            newCommand.initAsProceedCommand(direction, streetName, commandDistance);
+            newCommand.initAsProceedCommand(direction, name, commandDistance);
             commands.push_back(newCommand);
         }
         DeliveryCommand deliver;
         deliver.initAsDeliverCommand(it->item);
         commands.push_back(deliver);
-        prev = it->location;
+        leg++;
         it++;
     }
     
     // time to go back to the depot!
-    DeliveryResult returnHome = ppr.generatePointToPointRoute(prev, depot, segRoute, distance);
+    DeliveryResult returnHome = legResults[leg];
     if (returnHome != DELIVERY_SUCCESS) return returnHome; // if point router doesn't get route, return!
-    totalDistanceTravelled += distance;
-    StreetSegment previousSegment;
+    totalDistanceTravelled += legDistances[leg];
+    const vector<SegmentRef>& segRoute = legRoutes[leg];
+    SegmentRef previousSegment;
     auto segIt = segRoute.begin(); // iterate the destination route
     while (segIt != segRoute.end())
     {
         DeliveryCommand newCommand;
-        string streetName = (*segIt).name; // maintain streetname
+        uint32_t streetName = segIt->nameId(); // maintain streetname
         double commandDistance = 0;
         double angle = angleOfLine(*segIt);
         if (segIt != segRoute.begin())
@@ -134,24 +206,25 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
             if (diffAngle >= 1 && diffAngle < 180)
             {
                 DeliveryCommand turnCommand;
-                turnCommand.initAsTurnCommand("left", segIt->name);
+                turnCommand.initAsTurnCommand("left", segIt->name());
                 commands.push_back(turnCommand);
             }
             else if (diffAngle >= 180 && diffAngle <= 359)
             {
                 DeliveryCommand turnCommand;
-                turnCommand.initAsTurnCommand("right", segIt->name);
+                turnCommand.initAsTurnCommand("right", segIt->name());
                 commands.push_back(turnCommand);
             }
         }
         previousSegment = *segIt;
-        while ((*segIt).name == streetName)
+        const char* name = segIt->name();
+        while (segIt != segRoute.end() && segIt->nameId() == streetName)
         {
-            commandDistance += distanceEarthMiles(segIt->start, segIt->end);
+            commandDistance += segIt->length();
             segIt++;
         }
         string direction = getDirection(angle);
-        newCommand.initAsProceedCommand(direction, streetName, commandDistance);
+        newCommand.initAsProceedCommand(direction, name, commandDistance);
         commands.push_back(newCommand);
     }
     return DELIVERY_SUCCESS;
@@ -172,6 +245,16 @@ DeliveryPlanner::~DeliveryPlanner()
     delete m_impl;
 }
 
+void DeliveryPlanner::setRouteCache(RouteCache* cache)
+{
+    m_impl->setRouteCache(cache);
+}
+
+void DeliveryPlanner::setThreadPool(ThreadPool* pool)
+{
+    m_impl->setThreadPool(pool);
+}
+
 DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
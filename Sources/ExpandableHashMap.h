@@ -3,6 +3,7 @@
 
 #include "provided.h"
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <functional>
 
@@ -12,16 +13,32 @@
 // member functions.
 
 const int START_BUCKET_AMOUNT = 8;
+const int REHASH_STEP_BUCKETS = 8; // old buckets moved per operation while rehashing incrementally
 
-template<typename KeyType, typename ValueType>
+// With incrementalRehash, growing the map does not move every entry at once.
+// The old buckets are kept and moved REHASH_STEP_BUCKETS at a time by later
+// calls to associate and (non-const) find, so no one call pays for the whole
+// rehash; lookups meanwhile check both bucket arrays.  Entries are spliced
+// from list to list, never copied, so pointers returned by find stay valid
+// while the map grows.
+//
+// Allocator supplies all of the map's memory (an ArenaAllocator from Arena.h,
+// for instance, so a map that lives for one query is freed in one step).
+
+template<typename KeyType, typename ValueType, typename Allocator = std::allocator<char>>
 class ExpandableHashMap
 {
 public:
-	ExpandableHashMap(double maximumLoadFactor = 0.5);
+	ExpandableHashMap(double maximumLoadFactor = 0.5, bool incrementalRehash = false,
+	                  const Allocator& allocator = Allocator());
 	~ExpandableHashMap();
 	void reset();
 	int size() const;
 	void associate(const KeyType& key, const ValueType& value);
+	  // make room for n associations up front, so inserting them never rehashes
+	void reserve(int n);
+	  // drop the association for key; false if there was none
+	bool remove(const KeyType& key);
 
 	  // for a map that can't be modified, return a pointer to const ValueType
 	const ValueType* find(const KeyType& key) const;
@@ -29,6 +46,7 @@ public:
 	  // for a modifiable map, return a pointer to modifiable ValueType
 	ValueType* find(const KeyType& key)
 	{
+		rehashStep();
 		return const_cast<ValueType*>(const_cast<const ExpandableHashMap*>(this)->find(key));
 	}
 
@@ -42,157 +60,282 @@ private:
     int m_bucketCount;
     int m_associations;
     double m_maximumLoadFactor;
+    bool m_incremental;
 
     struct KeyValuePair {
-        KeyValuePair(KeyType key, ValueType value) : key(key), value(value) {};
-        KeyValuePair(const KeyValuePair& pair)
-        {
-            key = pair.key;
-            value = pair.value;
-        }
-        KeyValuePair operator=(const KeyValuePair& pair)
-        {
-            key = pair.key;
-            value = pair.value;
-        }
+        KeyValuePair(const KeyType& key, const ValueType& value, unsigned int hash) : key(key), value(value), hash(hash) {};
         
         KeyType key;
         ValueType value;
+        unsigned int hash; // hasher(key), kept so rehashing and mismatches skip the key
     };
     
+    typedef std::allocator_traits<Allocator> Traits;
+    typedef typename Traits::template rebind_alloc<KeyValuePair> PairAllocator;
+    
     struct BUCKET {
-        std::list<KeyValuePair> m_content;
+        BUCKET(const PairAllocator& allocator) : m_content(allocator) {}
+        std::list<KeyValuePair, PairAllocator> m_content;
     };
     
-    std::vector<BUCKET*> m_buckets;
+    typedef typename Traits::template rebind_alloc<BUCKET> BucketAllocator;
+    typedef std::vector<BUCKET*, typename Traits::template rebind_alloc<BUCKET*>> BucketArray;
+    
+    Allocator m_allocator;
+    BucketArray m_buckets;     // nullptr until something lands there
+    BucketArray m_oldBuckets;  // being rehashed into m_buckets, if not empty
+    int m_rehashed;                     // m_oldBuckets [0, m_rehashed) are done
     
     void cleanUp();
+    BUCKET* newBucket();
+    void deleteBucket(BUCKET* bucket);
     
     double currentLoadFactor() const;
     void expandMap();
+    void growTo(int bucketCount);
+    void rehashStep();
+    void finishRehash();
+    void rehashBucket(int oldBucket);
+    const ValueType* find(const KeyType& key, unsigned int hashedValue) const;
+    static bool removeFrom(BUCKET* bucket, const KeyType& key, unsigned int hashedValue);
+    static const ValueType* findIn(const BUCKET* bucket, const KeyType& key, unsigned int hashedValue);
 };
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor) : m_bucketCount(START_BUCKET_AMOUNT), m_associations(0), m_maximumLoadFactor(maximumLoadFactor)
+template<typename KeyType, typename ValueType, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Allocator>::ExpandableHashMap(double maximumLoadFactor, bool incrementalRehash,
+                                                                  const Allocator& allocator)
+ : m_bucketCount(START_BUCKET_AMOUNT), m_associations(0), m_maximumLoadFactor(maximumLoadFactor),
+   m_incremental(incrementalRehash), m_allocator(allocator), m_buckets(START_BUCKET_AMOUNT, nullptr, allocator),
+   m_oldBuckets(allocator), m_rehashed(0)
 {
-    for (int i = 0; i < START_BUCKET_AMOUNT; i++)
-        m_buckets.push_back(new BUCKET);
 }
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap()
+template<typename KeyType, typename ValueType, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Allocator>::~ExpandableHashMap()
 {
     cleanUp(); // cleanUp is all we need!
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::reset()
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::reset()
 {
     cleanUp();
     m_bucketCount = START_BUCKET_AMOUNT;
     m_associations = 0;
-    for (int i = 0; i < START_BUCKET_AMOUNT; i++)
-        m_buckets.push_back(new BUCKET);
+    m_buckets.assign(START_BUCKET_AMOUNT, nullptr);
 }
 
-template<typename KeyType, typename ValueType>
-int ExpandableHashMap<KeyType, ValueType>::size() const
+template<typename KeyType, typename ValueType, typename Allocator>
+int ExpandableHashMap<KeyType, ValueType, Allocator>::size() const
 {
     return m_associations;  // Return # of associations. Easy!
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::associate(const KeyType& key, const ValueType& value)
 {
     unsigned int hasher(const KeyType& k);
-    unsigned int hashedValue = hasher(key);
-    int bucket = hashedValue % m_bucketCount;
-    ValueType* pointerVal = find(key);
+    unsigned int hashedValue = hasher(key); // once, for the lookup and the insert
+    rehashStep(); // move the next few old buckets, if rehashing
+    ValueType* pointerVal = const_cast<ValueType*>(find(key, hashedValue));
     if (pointerVal != nullptr)
     {
         *pointerVal = value;
     }
     else
     {
-        KeyValuePair pair(key, value);
-        m_buckets[bucket]->m_content.push_back(pair);
+        int bucket = hashedValue % m_bucketCount;
+        if (m_buckets[bucket] == nullptr)
+            m_buckets[bucket] = newBucket();
+        m_buckets[bucket]->m_content.push_back(KeyValuePair(key, value, hashedValue));
         m_associations++;
         if (currentLoadFactor() > m_maximumLoadFactor)
             expandMap();
     }
 }
 
-template<typename KeyType, typename ValueType>
-const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::reserve(int n)
+{
+    int needed = m_bucketCount;
+    while (n > m_maximumLoadFactor * needed)
+        needed *= 2;
+    if (needed == m_bucketCount) return;
+    finishRehash();
+    growTo(needed);
+    finishRehash(); // reserving is the moment to pay, not later
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+bool ExpandableHashMap<KeyType, ValueType, Allocator>::remove(const KeyType& key)
 {
     unsigned int hasher(const KeyType& k);
     unsigned int hashedValue = hasher(key);
-    int bucket = hashedValue % m_bucketCount;
-    typename std::list<KeyValuePair>::iterator it = m_buckets[bucket]->m_content.begin();
-    while (it != m_buckets[bucket]->m_content.end())
+    rehashStep();
+    bool removed = removeFrom(m_buckets[hashedValue % m_bucketCount], key, hashedValue);
+    if (!removed && !m_oldBuckets.empty())
     {
-        if ((*it).key == key)
+        int oldBucket = hashedValue % m_oldBuckets.size();
+        if (oldBucket >= m_rehashed) // not moved yet
+            removed = removeFrom(m_oldBuckets[oldBucket], key, hashedValue);
+    }
+    if (removed)
+        m_associations--;
+    return removed;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Allocator>::find(const KeyType& key) const
+{
+    unsigned int hasher(const KeyType& k);
+    return find(key, hasher(key));
+}
+
+// PRIVATE MEMBER FUNCTIONS
+
+template<typename KeyType, typename ValueType, typename Allocator>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Allocator>::find(const KeyType& key, unsigned int hashedValue) const
+{
+    const ValueType* found = findIn(m_buckets[hashedValue % m_bucketCount], key, hashedValue);
+    if (found == nullptr && !m_oldBuckets.empty())
+    {
+        int oldBucket = hashedValue % m_oldBuckets.size();
+        if (oldBucket >= m_rehashed) // not moved yet
+            found = findIn(m_oldBuckets[oldBucket], key, hashedValue);
+    }
+    return found;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Allocator>::findIn(const BUCKET* bucket, const KeyType& key, unsigned int hashedValue)
+{
+    if (bucket == nullptr) return nullptr;
+    auto it = bucket->m_content.cbegin();
+    while (it != bucket->m_content.end())
+    {
+        if ((*it).hash == hashedValue && (*it).key == key) // compare keys only when the hashes agree
             return &((*it).value);
         it++;
     }
     return nullptr;
 }
 
-// PRIVATE MEMBER FUNCTIONS
-
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::cleanUp()
+template<typename KeyType, typename ValueType, typename Allocator>
+bool ExpandableHashMap<KeyType, ValueType, Allocator>::removeFrom(BUCKET* bucket, const KeyType& key, unsigned int hashedValue)
 {
-    typename std::vector<BUCKET*>::iterator it = m_buckets.begin();
-    while (it != m_buckets.end())
+    if (bucket == nullptr) return false;
+    for (auto it = bucket->m_content.begin(); it != bucket->m_content.end(); it++)
     {
-        BUCKET* tempBucket = (*it);
-        it = m_buckets.erase(it);
-        delete tempBucket;
+        if ((*it).hash == hashedValue && (*it).key == key)
+        {
+            bucket->m_content.erase(it); // the bucket itself stays for the next arrival
+            return true;
+        }
     }
+    return false;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::cleanUp()
+{
+    for (BUCKET* bucket : m_buckets)
+        deleteBucket(bucket);
+    for (BUCKET* bucket : m_oldBuckets)
+        deleteBucket(bucket);
+    m_buckets.clear();
+    BucketArray(m_allocator).swap(m_oldBuckets);
+    m_rehashed = 0;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+typename ExpandableHashMap<KeyType, ValueType, Allocator>::BUCKET* ExpandableHashMap<KeyType, ValueType, Allocator>::newBucket()
+{
+    BucketAllocator allocator(m_allocator);
+    BUCKET* bucket = std::allocator_traits<BucketAllocator>::allocate(allocator, 1);
+    std::allocator_traits<BucketAllocator>::construct(allocator, bucket, PairAllocator(m_allocator));
+    return bucket;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::deleteBucket(BUCKET* bucket)
+{
+    if (bucket == nullptr) return;
+    BucketAllocator allocator(m_allocator);
+    std::allocator_traits<BucketAllocator>::destroy(allocator, bucket);
+    std::allocator_traits<BucketAllocator>::deallocate(allocator, bucket, 1);
 }
 
-template<typename KeyType, typename ValueType>
-double ExpandableHashMap<KeyType, ValueType>::currentLoadFactor() const
+template<typename KeyType, typename ValueType, typename Allocator>
+double ExpandableHashMap<KeyType, ValueType, Allocator>::currentLoadFactor() const
 {
     return m_associations*1.0 / m_bucketCount;
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::expandMap()
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::expandMap()
 {
-    unsigned int hasher(const KeyType& k);
-    int newSize = m_bucketCount * 2; // double the bucket count
-    std::vector<BUCKET*> newBucket;
-    for (int i = 0; i < newSize; i++)
-        newBucket.push_back(new BUCKET);
-    for (int j = 0; j < m_bucketCount; j++)
+    finishRehash(); // only left over if lookups were scarce and the load factor tiny
+    growTo(m_bucketCount * 2); // double the bucket count
+    if (!m_incremental)
+        finishRehash();
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::growTo(int bucketCount)
+{
+    m_oldBuckets.swap(m_buckets);
+    m_buckets.assign(bucketCount, nullptr);
+    m_bucketCount = bucketCount;
+    m_rehashed = 0;
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::rehashStep()
+{
+    for (int i = 0; i < REHASH_STEP_BUCKETS && !m_oldBuckets.empty(); i++)
+        rehashBucket(m_rehashed);
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::finishRehash()
+{
+    while (!m_oldBuckets.empty())
+        rehashBucket(m_rehashed);
+}
+
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::rehashBucket(int oldBucket)
+{
+    BUCKET* old = m_oldBuckets[oldBucket];
+    if (old != nullptr)
     {
-        if (m_buckets[j]->m_content.size() == 0) continue;
-        typename std::list<KeyValuePair>::iterator it = m_buckets[j]->m_content.begin();
-        int bucket; // bucket number to be determined in while loop
-        while (it != m_buckets[j]->m_content.end())
+        while (!old->m_content.empty())
         {
-            bucket = hasher((*it).key) % newSize;
-            KeyValuePair pair((*it).key, (*it).value);
-            newBucket[bucket]->m_content.push_back(pair);
-            it++;
+            int bucket = old->m_content.front().hash % m_bucketCount; // stored, so no key is rehashed
+            if (m_buckets[bucket] == nullptr)
+                m_buckets[bucket] = newBucket();
+            // move the list node itself: no copy, and pointers into it stay good
+            m_buckets[bucket]->m_content.splice(m_buckets[bucket]->m_content.end(), old->m_content, old->m_content.begin());
         }
+        deleteBucket(old);
+        m_oldBuckets[oldBucket] = nullptr;
+    }
+    m_rehashed++;
+    if (m_rehashed == (int)m_oldBuckets.size())
+    {
+        BucketArray(m_allocator).swap(m_oldBuckets);
+        m_rehashed = 0;
     }
-    
-    cleanUp(); // delete old m_buckets;
-    m_bucketCount = newSize;
-    m_buckets.swap(newBucket);
 }
 
 // DELETE THIS FUNCTION LATER
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::print() const
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::print() const
 {
     for (int i = 0; i < m_bucketCount; i++)
     {
-        if (m_buckets[i]->m_content.size() == 0) continue;
+        if (m_buckets[i] == nullptr || m_buckets[i]->m_content.size() == 0) continue;
         auto it = m_buckets[i]->m_content.begin();
         while (it != m_buckets[i]->m_content.end())
         {
@@ -0,0 +1,229 @@
+#ifndef FLATHASHMAP_INCLUDED
+#define FLATHASHMAP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// FlatHashMap.h
+
+// An open-addressing alternative to ExpandableHashMap with the same interface
+// and the same hasher() functions.  Entries live in one flat array, with a
+// parallel array of small control records (the key's hash and how far the
+// entry sits from its home slot), so a lookup is a short linear scan of
+// memory and an insert allocates nothing until the table grows.
+//
+// Collisions are resolved Robin Hood style: an entry being inserted takes the
+// slot of any entry closer to its own home, which keeps probe sequences short
+// and lets a failed lookup stop as soon as it passes where the key would be.
+//
+// As with any open-addressing table, pointers returned by find are only good
+// until the next associate or reset.
+
+const uint32_t FLAT_START_CAPACITY = 16;
+
+template<typename KeyType, typename ValueType>
+class FlatHashMap
+{
+public:
+	FlatHashMap(double maximumLoadFactor = 0.75);
+	~FlatHashMap();
+	void reset();
+	int size() const;
+	void associate(const KeyType& key, const ValueType& value);
+
+	  // for a map that can't be modified, return a pointer to const ValueType
+	const ValueType* find(const KeyType& key) const;
+
+	  // for a modifiable map, return a pointer to modifiable ValueType
+	ValueType* find(const KeyType& key)
+	{
+		return const_cast<ValueType*>(const_cast<const FlatHashMap*>(this)->find(key));
+	}
+
+	FlatHashMap(const FlatHashMap&) = delete;
+	FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+private:
+    struct Control
+    {
+        uint32_t hash;
+        uint32_t distance;  // 0 for an empty slot, else 1 + distance from the home slot
+    };
+
+    struct KeyValuePair
+    {
+        KeyValuePair(const KeyType& k, const ValueType& v) : key(k), value(v) {}
+        KeyType key;
+        ValueType value;
+    };
+
+    Control*      m_control;
+    KeyValuePair* m_entries;    // constructed only where m_control says so
+    uint32_t      m_capacity;   // power of two
+    int           m_associations;
+    double        m_maximumLoadFactor;
+
+    void allocate(uint32_t capacity);
+    void destroy();
+    void expandMap();
+      // find for a key whose hash is already known
+    const ValueType* find(const KeyType& key, uint32_t hash) const;
+      // insert an entry known not to be present
+    void place(uint32_t hash, KeyValuePair&& pair);
+};
+
+template<typename KeyType, typename ValueType>
+FlatHashMap<KeyType, ValueType>::FlatHashMap(double maximumLoadFactor)
+ : m_control(nullptr), m_entries(nullptr), m_capacity(0), m_associations(0), m_maximumLoadFactor(maximumLoadFactor)
+{
+    if (!(m_maximumLoadFactor > 0.1)) m_maximumLoadFactor = 0.1;
+    if (m_maximumLoadFactor > 0.95) m_maximumLoadFactor = 0.95; // Robin Hood degrades past this
+    allocate(FLAT_START_CAPACITY);
+}
+
+template<typename KeyType, typename ValueType>
+FlatHashMap<KeyType, ValueType>::~FlatHashMap()
+{
+    destroy();
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::reset()
+{
+    destroy();
+    allocate(FLAT_START_CAPACITY);
+}
+
+template<typename KeyType, typename ValueType>
+int FlatHashMap<KeyType, ValueType>::size() const
+{
+    return m_associations;
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+{
+    unsigned int hasher(const KeyType& k);
+    uint32_t hash = (uint32_t)hasher(key); // once, for both the lookup and the insert
+    ValueType* existing = const_cast<ValueType*>(find(key, hash));
+    if (existing != nullptr)
+    {
+        *existing = value;
+        return;
+    }
+    if (m_associations + 1 > m_maximumLoadFactor * m_capacity)
+        expandMap();
+    place(hash, KeyValuePair(key, value));
+    m_associations++;
+}
+
+template<typename KeyType, typename ValueType>
+const ValueType* FlatHashMap<KeyType, ValueType>::find(const KeyType& key) const
+{
+    unsigned int hasher(const KeyType& k);
+    return find(key, (uint32_t)hasher(key));
+}
+
+// PRIVATE MEMBER FUNCTIONS
+
+template<typename KeyType, typename ValueType>
+const ValueType* FlatHashMap<KeyType, ValueType>::find(const KeyType& key, uint32_t hash) const
+{
+    uint32_t mask = m_capacity - 1;
+    uint32_t slot = hash & mask;
+    for (uint32_t distance = 1; ; distance++)
+    {
+        const Control& c = m_control[slot];
+        // an empty slot, or an entry closer to home than the key would be,
+        // means the key is not here: Robin Hood would have placed it earlier
+        if (c.distance < distance) return nullptr;
+        if (c.hash == hash && m_entries[slot].key == key)
+            return &m_entries[slot].value;
+        slot = (slot + 1) & mask;
+    }
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::allocate(uint32_t capacity)
+{
+    m_capacity = capacity;
+    m_associations = 0;
+    m_control = new Control[capacity]();
+    m_entries = std::allocator<KeyValuePair>().allocate(capacity);
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::destroy()
+{
+    for (uint32_t i = 0; i < m_capacity; i++)
+    {
+        if (m_control[i].distance != 0)
+            m_entries[i].~KeyValuePair();
+    }
+    std::allocator<KeyValuePair>().deallocate(m_entries, m_capacity);
+    delete [] m_control;
+    m_control = nullptr;
+    m_entries = nullptr;
+    m_capacity = 0;
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::place(uint32_t hash, KeyValuePair&& pair)
+{
+    // Robin Hood keeps each run of entries in order of home slot, so taking
+    // from the rich comes down to this: the entry goes to the first slot
+    // whose entry is nearer its home than the new one would be, and the rest
+    // of the run moves up one slot.  Each of those is moved once, where
+    // swapping along the run would move it three times.
+    uint32_t mask = m_capacity - 1;
+    uint32_t slot = hash & mask;
+    uint32_t distance = 1;
+    for (; m_control[slot].distance >= distance; distance++)
+        slot = (slot + 1) & mask;
+    uint32_t empty = slot;
+    while (m_control[empty].distance != 0)
+        empty = (empty + 1) & mask;
+    if (empty == slot)
+        new (&m_entries[slot]) KeyValuePair(std::move(pair));
+    else
+    {
+        uint32_t i = (empty - 1) & mask;
+        new (&m_entries[empty]) KeyValuePair(std::move(m_entries[i]));
+        m_control[empty].hash = m_control[i].hash;
+        m_control[empty].distance = m_control[i].distance + 1;
+        for (; i != slot; i = (i - 1) & mask)
+        {
+            uint32_t before = (i - 1) & mask;
+            m_entries[i] = std::move(m_entries[before]);
+            m_control[i].hash = m_control[before].hash;
+            m_control[i].distance = m_control[before].distance + 1;
+        }
+        m_entries[slot] = std::move(pair);
+    }
+    m_control[slot].hash = hash;
+    m_control[slot].distance = distance;
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::expandMap()
+{
+    Control* oldControl = m_control;
+    KeyValuePair* oldEntries = m_entries;
+    uint32_t oldCapacity = m_capacity;
+    int associations = m_associations;
+    allocate(oldCapacity * 2);
+    m_associations = associations;
+    for (uint32_t i = 0; i < oldCapacity; i++)
+    {
+        if (oldControl[i].distance == 0) continue;
+        place(oldControl[i].hash, std::move(oldEntries[i])); // stored hashes, so no key is rehashed
+        oldEntries[i].~KeyValuePair();
+    }
+    std::allocator<KeyValuePair>().deallocate(oldEntries, oldCapacity);
+    delete [] oldControl;
+}
+
+#endif // FLATHASHMAP_INCLUDED
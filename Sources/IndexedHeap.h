@@ -0,0 +1,144 @@
+#ifndef INDEXEDHEAP_INCLUDED
+#define INDEXEDHEAP_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// IndexedHeap.h
+
+// A binary min-heap of node ids keyed by doubles, with the position of every
+// node kept alongside so a node already in the heap can have its key lowered
+// in place (decrease-key) instead of being pushed again.  Push, pop and
+// decrease-key are O(log n); contains is O(1).  Equal keys come out in node
+// id order, so searches are deterministic.
+//
+// The position array is sized once for the graph; clear() only touches the
+// nodes still in the heap, so a heap reused across searches costs nothing to
+// empty.
+
+const uint32_t NOT_IN_HEAP = 0xFFFFFFFF;
+
+class IndexedHeap
+{
+public:
+    IndexedHeap() {}
+      // make room for nodes [0, nodeCount) and empty the heap
+    void reset(uint32_t nodeCount)
+    {
+        clear();
+        if (m_position.size() != nodeCount)
+            m_position.assign(nodeCount, NOT_IN_HEAP);
+    }
+    void clear()
+    {
+        for (const Item& item : m_heap)
+            m_position[item.node] = NOT_IN_HEAP;
+        m_heap.clear();
+    }
+    bool empty() const { return m_heap.empty(); }
+    size_t size() const { return m_heap.size(); }
+    bool contains(NodeId n) const { return m_position[n] != NOT_IN_HEAP; }
+    double key(NodeId n) const { return m_heap[m_position[n]].key; }
+    NodeId top() const { return m_heap[0].node; }
+    double topKey() const { return m_heap[0].key; }
+
+      // add n, or lower its key if it is already here with a larger one
+    void pushOrDecrease(NodeId n, double key)
+    {
+        uint32_t i = m_position[n];
+        if (i == NOT_IN_HEAP)
+        {
+            i = (uint32_t)m_heap.size();
+            Item item = { key, n };
+            m_heap.push_back(item);
+            m_position[n] = i;
+        }
+        else if (key < m_heap[i].key)
+            m_heap[i].key = key;
+        else
+            return;
+        siftUp(i);
+    }
+
+      // add n, or move it to key whether that is larger or smaller
+    void pushOrUpdate(NodeId n, double key)
+    {
+        uint32_t i = m_position[n];
+        if (i == NOT_IN_HEAP || key < m_heap[i].key)
+        {
+            pushOrDecrease(n, key);
+            return;
+        }
+        m_heap[i].key = key;
+        siftDown(i);
+    }
+
+    NodeId pop()
+    {
+        NodeId n = m_heap[0].node;
+        m_position[n] = NOT_IN_HEAP;
+        Item last = m_heap.back();
+        m_heap.pop_back();
+        if (!m_heap.empty())
+        {
+            m_heap[0] = last;
+            m_position[last.node] = 0;
+            siftDown(0);
+        }
+        return n;
+    }
+
+private:
+    struct Item
+    {
+        double key;
+        NodeId node;
+    };
+
+    std::vector<Item>     m_heap;
+    std::vector<uint32_t> m_position;  // index in m_heap, by node
+
+    static bool before(const Item& a, const Item& b)
+    {
+        return a.key < b.key || (a.key == b.key && a.node < b.node);
+    }
+
+    void place(uint32_t i, const Item& item)
+    {
+        m_heap[i] = item;
+        m_position[item.node] = i;
+    }
+
+    void siftUp(uint32_t i)
+    {
+        Item item = m_heap[i];
+        while (i > 0)
+        {
+            uint32_t parent = (i - 1) / 2;
+            if (!before(item, m_heap[parent])) break;
+            place(i, m_heap[parent]);
+            i = parent;
+        }
+        place(i, item);
+    }
+
+    void siftDown(uint32_t i)
+    {
+        Item item = m_heap[i];
+        uint32_t count = (uint32_t)m_heap.size();
+        for (;;)
+        {
+            uint32_t child = 2 * i + 1;
+            if (child >= count) break;
+            if (child + 1 < count && before(m_heap[child + 1], m_heap[child])) child++;
+            if (!before(m_heap[child], item)) break;
+            place(i, m_heap[child]);
+            i = child;
+        }
+        place(i, item);
+    }
+};
+
+#endif // INDEXEDHEAP_INCLUDED
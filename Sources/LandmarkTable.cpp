@@ -0,0 +1,204 @@
+#include "LandmarkTable.h"
+#include "IndexedHeap.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+using namespace std;
+
+LandmarkTable::LandmarkTable()
+ : m_graph(nullptr)
+{
+}
+
+void LandmarkTable::clear()
+{
+    m_graph = nullptr;
+    m_landmarks.clear();
+    m_distances.clear();
+}
+
+void LandmarkTable::build(const StreetGraph& graph, int count, LandmarkSelection how)
+{
+    clear();
+    uint32_t n = graph.nodeCount();
+    if (n == 0 || count <= 0) return;
+    if ((uint32_t)count > n) count = (int)n;
+    m_graph = &graph;
+    // columns not filled in yet hold infinity, which lowerBound ignores
+    m_landmarks.assign(count, NO_NODE);
+    m_distances.assign((size_t)n * count, numeric_limits<double>::infinity());
+
+    // landmarks all go to the largest connected piece of the map, where
+    // nearly every route is; elsewhere the bound falls back to the straight line
+    vector<char> inLargest;
+    NodeId seed = largestPiece(inLargest);
+    vector<NodeId> pieceNodes;
+    for (NodeId v = 0; v < n; v++)
+    {
+        if (inLargest[v]) pieceNodes.push_back(v);
+    }
+
+    vector<double> miles, nearest; // nearest: to the closest landmark so far
+    vector<NodeId> parent, settled;
+    shortestPaths(seed, nearest, parent, settled); // the first landmark is the node farthest from seed
+    mt19937 random(7); // roots for avoid, the same every build
+    uniform_int_distribution<size_t> anyNode(0, pieceNodes.size() - 1);
+    for (int i = 0; i < count; i++)
+    {
+        NodeId chosen = NO_NODE;
+        if (i > 0 && how == LANDMARKS_AVOID)
+            chosen = avoid(pieceNodes[anyNode(random)]);
+        if (chosen == NO_NODE)
+            chosen = farthest(nearest);
+        if (chosen == NO_NODE) // every node of the piece is a landmark already
+        {
+            m_landmarks.resize(i);
+            vector<double> table((size_t)n * i);
+            for (NodeId v = 0; v < n; v++)
+                copy(&m_distances[(size_t)v * count], &m_distances[(size_t)v * count] + i, &table[(size_t)v * i]);
+            m_distances.swap(table);
+            return;
+        }
+        m_landmarks[i] = chosen;
+        shortestPaths(chosen, miles, parent, settled);
+        for (NodeId v = 0; v < n; v++)
+        {
+            m_distances[(size_t)v * count + i] = miles[v];
+            if (i == 0 || miles[v] < nearest[v]) nearest[v] = miles[v];
+        }
+    }
+}
+
+NodeId LandmarkTable::largestPiece(vector<char>& inLargest) const
+{
+    const StreetGraph& graph = *m_graph;
+    uint32_t n = graph.nodeCount();
+    vector<uint32_t> piece(n, NO_NODE);
+    vector<uint32_t> sizes;
+    vector<NodeId> stack;
+    for (NodeId s = 0; s < n; s++)
+    {
+        if (piece[s] != NO_NODE) continue;
+        uint32_t id = (uint32_t)sizes.size();
+        sizes.push_back(0);
+        piece[s] = id;
+        stack.push_back(s);
+        while (!stack.empty())
+        {
+            NodeId v = stack.back();
+            stack.pop_back();
+            sizes[id]++;
+            for (EdgeId e = graph.edgeBegin(v); e < graph.edgeEnd(v); e++)
+            {
+                if (piece[graph.edgeTarget(e)] != NO_NODE) continue;
+                piece[graph.edgeTarget(e)] = id;
+                stack.push_back(graph.edgeTarget(e));
+            }
+        }
+    }
+    uint32_t largest = (uint32_t)(max_element(sizes.begin(), sizes.end()) - sizes.begin());
+    inLargest.assign(n, false);
+    NodeId seed = NO_NODE;
+    for (NodeId v = 0; v < n; v++)
+    {
+        if (piece[v] != largest) continue;
+        inLargest[v] = true;
+        if (seed == NO_NODE) seed = v;
+    }
+    return seed;
+}
+
+void LandmarkTable::shortestPaths(NodeId source, vector<double>& miles, vector<NodeId>& parent,
+                                  vector<NodeId>& settled) const
+{
+    const StreetGraph& graph = *m_graph;
+    miles.assign(graph.nodeCount(), numeric_limits<double>::infinity());
+    parent.assign(graph.nodeCount(), NO_NODE);
+    settled.clear();
+    IndexedHeap open;
+    open.reset(graph.nodeCount());
+    miles[source] = 0;
+    open.pushOrDecrease(source, 0);
+    while (!open.empty())
+    {
+        NodeId curr = open.pop();
+        settled.push_back(curr);
+        for (EdgeId e = graph.edgeBegin(curr); e < graph.edgeEnd(curr); e++)
+        {
+            NodeId next = graph.edgeTarget(e);
+            double distance = miles[curr] + graph.edgeLength(e);
+            if (distance >= miles[next]) continue;
+            miles[next] = distance;
+            parent[next] = curr;
+            open.pushOrDecrease(next, distance);
+        }
+    }
+}
+
+NodeId LandmarkTable::farthest(const vector<double>& nearestLandmark) const
+{
+    // nodes no landmark reaches are in another piece of the map
+    NodeId best = NO_NODE;
+    for (NodeId v = 0; v < m_graph->nodeCount(); v++)
+    {
+        if (nearestLandmark[v] > 0 && !std::isinf(nearestLandmark[v]) &&
+            (best == NO_NODE || nearestLandmark[v] > nearestLandmark[best]))
+            best = v;
+    }
+    return best;
+}
+
+NodeId LandmarkTable::avoid(NodeId root) const
+{
+    vector<double> miles;
+    vector<NodeId> parent, settled;
+    shortestPaths(root, miles, parent, settled);
+
+    // weight: how far the bound from the landmarks so far falls short of
+    // the real distance from root; size: the weight of a whole subtree.
+    // Subtrees already holding a landmark are covered, and skipped below.
+    uint32_t n = m_graph->nodeCount();
+    vector<double> size(n, 0);
+    vector<char> covered(n, false);
+    for (NodeId v : m_landmarks)
+    {
+        if (v != NO_NODE) covered[v] = true;
+    }
+    for (size_t i = settled.size(); i-- > 0; ) // children before parents
+    {
+        NodeId v = settled[i];
+        size[v] += miles[v] - lowerBound(root, v);
+        NodeId up = parent[v];
+        if (up == NO_NODE) continue;
+        if (covered[v]) covered[up] = true;
+        size[up] += size[v];
+    }
+
+    // children of every node in the tree, then down the heaviest branch to a leaf
+    vector<uint32_t> childStart(n + 1, 0);
+    for (NodeId v : settled)
+    {
+        if (parent[v] != NO_NODE) childStart[parent[v] + 1]++;
+    }
+    for (uint32_t v = 0; v < n; v++)
+        childStart[v + 1] += childStart[v];
+    vector<NodeId> children(childStart[n]);
+    vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+    for (NodeId v : settled)
+    {
+        if (parent[v] != NO_NODE) children[fill[parent[v]]++] = v;
+    }
+    NodeId at = root;
+    for (;;)
+    {
+        NodeId heaviest = NO_NODE;
+        for (uint32_t i = childStart[at]; i < childStart[at + 1]; i++)
+        {
+            NodeId c = children[i];
+            if (!covered[c] && size[c] > 0 && (heaviest == NO_NODE || size[c] > size[heaviest]))
+                heaviest = c;
+        }
+        if (heaviest == NO_NODE) return covered[at] ? NO_NODE : at;
+        at = heaviest;
+    }
+}
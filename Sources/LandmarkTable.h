@@ -0,0 +1,82 @@
+#ifndef LANDMARKTABLE_INCLUDED
+#define LANDMARKTABLE_INCLUDED
+
+#include "StreetGraph.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LandmarkTable.h
+
+// Landmarks for A* (the ALT heuristic).  A few nodes, chosen far apart
+// towards the edges of the map, get the shortest distance from them to every
+// node worked out in advance.  By the triangle inequality the route from v to
+// t is at least |dist(L, t) - dist(L, v)| for any landmark L, and the largest
+// of these is a lower bound that, unlike the straight line, knows about
+// rivers, freeways and dead ends: a search stops expanding nodes on the far
+// side of them.  Each bound is consistent, so A* stays exact.
+//
+// The parser adds every segment in both directions with the same length, so
+// the distance to a landmark equals the distance from it and one table serves
+// both.  Distances are stored node by node, all landmarks of a node side by
+// side, so a bound reads one short run of memory.
+//
+// Landmarks are picked either as the node farthest from those chosen so far,
+// or by "avoid": grow a shortest path tree from a node, weight every node by
+// how badly the current landmarks bound its distance from the root, and take
+// the leaf at the end of the heaviest branch that holds no landmark yet.
+// Either way they all go to the largest connected piece of the map; routes
+// in the small pieces left over get no bound from them.
+
+class LandmarkTable
+{
+public:
+    LandmarkTable();
+      // pick count landmarks of graph, which must outlive the table (or the
+      // next build/clear), and find their distances to every node
+    void build(const StreetGraph& graph, int count, LandmarkSelection how);
+    void clear();
+    bool empty() const { return m_graph == nullptr; }
+
+    int count() const { return (int)m_landmarks.size(); }
+    NodeId landmark(int i) const { return m_landmarks[i]; }
+      // miles from landmark i to n, infinity if n cannot be reached
+    double distance(int i, NodeId n) const { return m_distances[(size_t)n * m_landmarks.size() + i]; }
+      // bytes taken by the distance table
+    size_t memoryUsage() const { return m_distances.size() * sizeof(double); }
+
+      // a lower bound on the miles from v to t
+    double lowerBound(NodeId v, NodeId t) const
+    {
+        size_t k = m_landmarks.size();
+        const double* dv = &m_distances[(size_t)v * k];
+        const double* dt = &m_distances[(size_t)t * k];
+        double best = 0;
+        for (size_t i = 0; i < k; i++)
+        {
+            double d = dt[i] - dv[i];
+            if (d < 0) d = -d;
+            if (d > best && !std::isinf(d)) best = d; // unreachable from a landmark: no bound
+        }
+        return best;
+    }
+
+    LandmarkTable(const LandmarkTable&) = delete;
+    LandmarkTable& operator=(const LandmarkTable&) = delete;
+private:
+    const StreetGraph*  m_graph;
+    std::vector<NodeId> m_landmarks;
+    std::vector<double> m_distances;  // [nodeCount * count], node by node
+
+      // Dijkstra from source: miles to every node, the node each was reached
+      // from, and the nodes in the order they were settled
+    void shortestPaths(NodeId source, std::vector<double>& miles, std::vector<NodeId>& parent,
+                       std::vector<NodeId>& settled) const;
+      // mark the nodes of the largest connected piece of the map; returns one of them
+    NodeId largestPiece(std::vector<char>& inLargest) const;
+    NodeId farthest(const std::vector<double>& nearestLandmark) const;
+    NodeId avoid(NodeId root) const;
+};
+
+#endif // LANDMARKTABLE_INCLUDED
@@ -0,0 +1,309 @@
+#include "MapParser.h"
+#include "Parallel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+bool parseCoordinate(const char* begin, const char* end, double& value)
+{
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int significant = 0;   // digits after any leading zeros
+    int fraction = 0;      // digits after the decimal point
+    bool sawDigit = false;
+    bool sawPoint = false;
+    for (; p < end; p++)
+    {
+        if (*p >= '0' && *p <= '9')
+        {
+            sawDigit = true;
+            if (mantissa != 0 || *p != '0') significant++;
+            if (significant <= 19) mantissa = mantissa * 10 + (*p - '0');
+            if (sawPoint) fraction++;
+        }
+        else if (*p == '.' && !sawPoint)
+            sawPoint = true;
+        else
+            return false;
+    }
+    if (!sawDigit) return false;
+
+    if (significant <= 15 && fraction <= 22)
+    {
+        // both operands are exact doubles, so the one rounding IEEE division
+        // does gives the correctly rounded value, exactly what stod returns
+        value = (double)mantissa / powersOf10[fraction];
+    }
+    else
+    {
+        // too many digits for the exact fast path; rare, so let strtod do it
+        string text(begin, end);
+        value = strtod(text.c_str(), nullptr);
+        return true;
+    }
+    if (negative) value = -value;
+    return true;
+}
+
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+MapParser::MapParser(size_t blockSize)
+ : m_buffer(blockSize > 0 ? blockSize : 1), m_bytes(0), m_line(0), m_state(EXPECT_NAME), m_name(0), m_remaining(0)
+{
+}
+
+void MapParser::start(const string& mapFile)
+{
+    m_file = mapFile;
+    m_error.clear();
+    m_bytes = 0;
+    m_line = 0;
+    m_state = EXPECT_NAME;
+    m_remaining = 0;
+}
+
+bool MapParser::finish()
+{
+    if (m_state == EXPECT_COUNT)
+        return fail("street name is not followed by a segment count");
+    if (m_state == EXPECT_SEGMENT)
+        return fail("file ends " + to_string(m_remaining) + " segment(s) short");
+    return true;
+}
+
+const char* MapParser::parseLines(const char* p, const char* end, StreetGraphBuilder& builder, bool& ok)
+{
+    // parse every complete line and return where the first incomplete one starts
+    while (ok)
+    {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (newline == nullptr) break;
+        ok = parseLine(p, newline, builder);
+        p = newline + 1;
+    }
+    return p;
+}
+
+bool MapParser::parse(const string& mapFile, StreetGraphBuilder& builder)
+{
+    start(mapFile);
+    FILE* in = fopen(mapFile.c_str(), "rb");
+    if (in == nullptr) return fail("unable to open file");
+
+    bool ok = true;
+    bool eof = false;
+    size_t filled = 0; // bytes of m_buffer holding data, starting with a partial line
+    while (ok && !eof)
+    {
+        if (filled == m_buffer.size())
+            m_buffer.resize(2 * m_buffer.size()); // one line is longer than a block
+        size_t got = fread(m_buffer.data() + filled, 1, m_buffer.size() - filled, in);
+        eof = got == 0;
+        filled += got;
+        m_bytes += got;
+
+        const char* end = m_buffer.data() + filled;
+        const char* p = parseLines(m_buffer.data(), end, builder, ok);
+        if (ok && eof && p < end) // last line has no newline
+        {
+            ok = parseLine(p, end, builder);
+            p = end;
+        }
+        filled = end - p;
+        memmove(m_buffer.data(), p, filled); // carry the partial line over
+    }
+    if (ferror(in)) ok = fail("read error");
+    fclose(in);
+    return ok && finish();
+}
+
+bool MapParser::parse(const string& mapFile, StreetGraphBuilder& builder, unsigned int threads)
+{
+    if (threads <= 1) return parse(mapFile, builder);
+
+    start(mapFile);
+    int fd = ::open(mapFile.c_str(), O_RDONLY);
+    if (fd < 0) return fail("unable to open file");
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) return parse(mapFile, builder); // empty or unmappable; read it instead
+
+    const char* text = static_cast<const char*>(base);
+    vector<Chunk> chunks = splitRecords(text, text + st.st_size, 4 * (size_t)threads);
+    vector<StreetGraphBuilder> parts(chunks.size());
+    vector<unique_ptr<MapParser>> parsers(chunks.size());
+    vector<char> ok(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        parsers[i].reset(new MapParser(1));
+        parsers[i]->start(mapFile);
+        parsers[i]->m_line = chunks[i].firstLine;
+    }
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        bool chunkOk = true;
+        const char* p = parsers[i]->parseLines(chunks[i].begin, chunks[i].end, parts[i], chunkOk);
+        if (chunkOk && p < chunks[i].end)
+            chunkOk = parsers[i]->parseLine(p, chunks[i].end, parts[i]);
+        ok[i] = chunkOk;
+    });
+    munmap(base, st.st_size);
+    m_bytes = st.st_size;
+
+    // report the first error in file order, exactly as a serial parse would
+    bool result = true;
+    bool split = true; // every chunk but the last ended between records
+    for (size_t i = 0; i < chunks.size() && result; i++)
+    {
+        if (!ok[i] || (i + 1 == chunks.size() && !parsers[i]->finish()))
+        {
+            m_error = parsers[i]->m_error;
+            result = false;
+        }
+        else if (i + 1 < chunks.size() && parsers[i]->m_state != EXPECT_NAME)
+            split = false;
+    }
+    if (!split) return parse(mapFile, builder); // a bad count misled the split; only a serial parse can tell
+    if (!result) return false;
+    for (size_t i = 0; i < parts.size(); i++)
+        builder.merge(parts[i]);
+    return true;
+}
+
+vector<MapParser::Chunk> MapParser::splitRecords(const char* begin, const char* end, size_t chunks)
+{
+    // Walk the records by their counts, only looking for newlines in segment
+    // lines, and cut whenever a chunk has reached its share of the file.  A
+    // malformed count stops the walk; the chunk parser then reports it.
+    vector<Chunk> result;
+    size_t target = (end - begin) / (chunks > 0 ? chunks : 1) + 1;
+    Chunk current = { begin, begin, 0 };
+    size_t line = 0;
+    const char* p = begin;
+    while (p < end)
+    {
+        if (p - current.begin >= (ptrdiff_t)target) // p is at a record boundary
+        {
+            current.end = p;
+            result.push_back(current);
+            current.begin = p;
+            current.firstLine = line;
+        }
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (newline == nullptr) break;
+        line++;
+        if (newline == p || (newline == p + 1 && *p == '\r')) // blank line between records
+        {
+            p = newline + 1;
+            continue;
+        }
+        const char* count = newline + 1; // the name line is done, now the count
+        newline = static_cast<const char*>(memchr(count, '\n', end - count));
+        if (newline == nullptr) break;
+        line++;
+        size_t segments = 0;
+        const char* q = count;
+        while (q < newline && (*q == ' ' || *q == '\t')) q++;
+        const char* digits = q;
+        while (q < newline && *q >= '0' && *q <= '9' && q - digits < 9)
+            segments = segments * 10 + (*q++ - '0');
+        while (q < newline && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+        if (q != newline || q == digits) break;
+        p = newline + 1;
+        for (size_t i = 0; i < segments && p < end; i++)
+        {
+            newline = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = newline == nullptr ? end : newline + 1;
+            line++;
+        }
+    }
+    current.end = end;
+    result.push_back(current);
+    return result;
+}
+
+bool MapParser::parseLine(const char* begin, const char* end, StreetGraphBuilder& builder)
+{
+    m_line++;
+    if (end > begin && end[-1] == '\r') end--; // tolerate CRLF files
+
+    switch (m_state)
+    {
+      case EXPECT_NAME:
+        if (begin == end) return true; // blank lines between streets are harmless
+        m_name = builder.addName(begin, end - begin);
+        m_state = EXPECT_COUNT;
+        return true;
+
+      case EXPECT_COUNT:
+      {
+        while (begin < end && isBlank(*begin)) begin++;
+        while (end > begin && isBlank(end[-1])) end--;
+        if (begin == end || end - begin > 9) return fail("expected a segment count, found \"" + string(begin, end) + "\"");
+        size_t count = 0;
+        for (const char* p = begin; p < end; p++)
+        {
+            if (*p < '0' || *p > '9') return fail("expected a segment count, found \"" + string(begin, end) + "\"");
+            count = count * 10 + (*p - '0');
+        }
+        m_remaining = count;
+        m_state = count > 0 ? EXPECT_SEGMENT : EXPECT_NAME;
+        return true;
+      }
+
+      case EXPECT_SEGMENT:
+      {
+        const char* tokenBegin[4];
+        const char* tokenEnd[4];
+        double value[4];
+        int tokens = 0;
+        for (const char* p = begin; ; )
+        {
+            while (p < end && isBlank(*p)) p++;
+            if (p == end) break;
+            if (tokens == 4) return fail("expected 4 coordinates, found more");
+            tokenBegin[tokens] = p;
+            while (p < end && !isBlank(*p)) p++;
+            tokenEnd[tokens] = p;
+            if (!parseCoordinate(tokenBegin[tokens], tokenEnd[tokens], value[tokens]))
+                return fail("bad coordinate \"" + string(tokenBegin[tokens], tokenEnd[tokens]) + "\"");
+            tokens++;
+        }
+        if (tokens != 4) return fail("expected 4 coordinates, found " + to_string(tokens));
+        NodeId startNode = builder.addNode(tokenBegin[0], tokenEnd[0] - tokenBegin[0], tokenBegin[1], tokenEnd[1] - tokenBegin[1],
+                                           value[0], value[1]);
+        NodeId endNode = builder.addNode(tokenBegin[2], tokenEnd[2] - tokenBegin[2], tokenBegin[3], tokenEnd[3] - tokenBegin[3],
+                                         value[2], value[3]);
+        double length = distanceEarthMiles(value[0], value[1], value[2], value[3]); // the same both ways
+        builder.addEdge(startNode, endNode, m_name, length); // the actual segment
+        builder.addEdge(endNode, startNode, m_name, length); // and the reverse
+        if (--m_remaining == 0) m_state = EXPECT_NAME;
+        return true;
+      }
+    }
+    return true;
+}
+
+bool MapParser::fail(const string& what)
+{
+    m_error = m_file + ":" + to_string(m_line) + ": " + what;
+    return false;
+}
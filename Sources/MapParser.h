@@ -0,0 +1,72 @@
+#ifndef MAPPARSER_INCLUDED
+#define MAPPARSER_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// MapParser.h
+
+// Parser for mapdata.txt, which is a sequence of street records:
+//
+//   Westwood Boulevard                                  street name
+//   2                                                   number of segments
+//   34.0625329 -118.4470263 34.0632405 -118.4470467     start lat/lon, end lat/lon
+//   34.0632405 -118.4470467 34.0640027 -118.4470710
+//
+// The file is read in large blocks and parsed in place: coordinates are
+// decoded without stod, and their text and the street names go straight into
+// the builder's interned text, so steady-state parsing does not allocate.
+// Every segment is added to the builder in both directions.
+//
+// With more than one thread the file is mmapped and cut into chunks on
+// street record boundaries (found by a quick newline scan that follows the
+// segment counts).  Each chunk is parsed into its own builder, and the
+// builders are merged in file order, so the result is identical to a serial
+// parse no matter how many threads ran.
+
+  // Decode a decimal coordinate such as "-118.4470263".  Returns false if
+  // [begin, end) is not a plain decimal number.  The result is identical to
+  // std::stod's.
+bool parseCoordinate(const char* begin, const char* end, double& value);
+
+class MapParser
+{
+public:
+    MapParser(size_t blockSize = 1 << 20);
+    bool parse(const std::string& mapFile, StreetGraphBuilder& builder);
+    bool parse(const std::string& mapFile, StreetGraphBuilder& builder, unsigned int threads);
+      // after a failed parse, "file:line: what went wrong"
+    const std::string& error() const { return m_error; }
+    size_t bytesParsed() const { return m_bytes; }
+    MapParser(const MapParser&) = delete;
+    MapParser& operator=(const MapParser&) = delete;
+private:
+    enum State { EXPECT_NAME, EXPECT_COUNT, EXPECT_SEGMENT };
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+        size_t      firstLine;  // line number of begin, minus one
+    };
+
+    std::vector<char> m_buffer;
+    std::string m_file;
+    std::string m_error;
+    size_t   m_bytes;
+    size_t   m_line;
+    State    m_state;
+    uint32_t m_name;       // name id of the street being read
+    size_t   m_remaining;  // segments still expected for it
+
+    void start(const std::string& mapFile);
+    bool finish();
+    const char* parseLines(const char* begin, const char* end, StreetGraphBuilder& builder, bool& ok);
+    bool parseLine(const char* begin, const char* end, StreetGraphBuilder& builder);
+    bool fail(const std::string& what);
+    static std::vector<Chunk> splitRecords(const char* begin, const char* end, size_t chunks);
+};
+
+#endif // MAPPARSER_INCLUDED
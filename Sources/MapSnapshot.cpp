@@ -0,0 +1,212 @@
+#include "MapSnapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+static uint64_t alignTo8(uint64_t n)
+{
+    return (n + 7) & ~uint64_t(7);
+}
+
+  // byte size of every section for the given counts
+static void sectionSizes(const MapSnapshotHeader& h, uint64_t sizes[SECTION_COUNT])
+{
+    sizes[SECTION_LATITUDES] = uint64_t(h.nodeCount) * sizeof(double);
+    sizes[SECTION_LONGITUDES] = uint64_t(h.nodeCount) * sizeof(double);
+    sizes[SECTION_COORD_TEXT] = uint64_t(h.nodeCount) * 2 * sizeof(uint32_t);
+    sizes[SECTION_EDGE_OFFSETS] = (uint64_t(h.nodeCount) + 1) * sizeof(EdgeId);
+    sizes[SECTION_EDGE_TARGETS] = uint64_t(h.edgeCount) * sizeof(NodeId);
+    sizes[SECTION_EDGE_LENGTHS] = uint64_t(h.edgeCount) * sizeof(double);
+    sizes[SECTION_EDGE_NAMES] = uint64_t(h.edgeCount) * sizeof(uint32_t);
+    sizes[SECTION_EDGE_TWINS] = uint64_t(h.edgeCount) * sizeof(EdgeId);
+    sizes[SECTION_NAME_TEXT] = uint64_t(h.nameCount) * sizeof(uint32_t);
+    sizes[SECTION_TABLE] = uint64_t(h.tableSize) * sizeof(NodeId);
+    sizes[SECTION_TEXT] = h.textSize;
+}
+
+  // true if everything a lookup or search follows in a stays in bounds:
+  // edges, names and text offsets point inside their arrays, and the
+  // coordinate table has an empty slot to end every probe
+static bool validArrays(const StreetGraphArrays& a)
+{
+    bool ok = a.edgeOffsets[0] == 0 && a.edgeOffsets[a.nodeCount] == a.edgeCount
+        && a.text[a.textSize - 1] == '\0';
+    for (NodeId n = 0; ok && n < a.nodeCount; n++)
+        ok = a.edgeOffsets[n] <= a.edgeOffsets[n + 1]
+            && a.coordText[2 * n] < a.textSize && a.coordText[2 * n + 1] < a.textSize;
+    for (EdgeId e = 0; ok && e < a.edgeCount; e++)
+        ok = a.edgeTargets[e] < a.nodeCount && a.edgeNames[e] < a.nameCount
+            && (a.edgeTwins[e] == NO_EDGE || a.edgeTwins[e] < a.edgeCount);
+    for (uint32_t i = 0; ok && i < a.nameCount; i++)
+        ok = a.nameText[i] < a.textSize;
+    bool emptySlot = false;
+    for (uint32_t i = 0; ok && i < a.tableSize; i++)
+    {
+        emptySlot = emptySlot || a.table[i] == NO_NODE;
+        ok = a.table[i] == NO_NODE || a.table[i] < a.nodeCount;
+    }
+    return ok && emptySlot;
+}
+
+bool writeMapSnapshot(const StreetGraph& graph, const string& snapshotFile)
+{
+    const StreetGraphArrays& a = graph.arrays();
+    MapSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = MAP_SNAPSHOT_VERSION;
+    header.nodeCount = a.nodeCount;
+    header.edgeCount = a.edgeCount;
+    header.nameCount = a.nameCount;
+    header.tableSize = a.tableSize;
+    header.textSize = a.textSize;
+
+    const void* data[SECTION_COUNT] = {
+        a.latitudes, a.longitudes, a.coordText, a.edgeOffsets, a.edgeTargets,
+        a.edgeLengths, a.edgeNames, a.edgeTwins, a.nameText, a.table, a.text
+    };
+    uint64_t sizes[SECTION_COUNT];
+    sectionSizes(header, sizes);
+    uint64_t offset = sizeof(header);
+    for (int i = 0; i < SECTION_COUNT; i++)
+    {
+        header.sectionOffset[i] = alignTo8(offset);
+        offset = header.sectionOffset[i] + sizes[i];
+    }
+    header.fileSize = offset;
+
+    // written beside the destination and renamed over it, so a process that
+    // has the old snapshot mapped keeps its pages instead of seeing the file
+    // truncated under it
+    string tempFile = snapshotFile + ".tmp";
+    ofstream out(tempFile, ios::binary | ios::trunc);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    for (int i = 0; i < SECTION_COUNT; i++)
+    {
+        static const char zeros[8] = { 0 };
+        out.write(zeros, header.sectionOffset[i] - written); // padding up to the section start
+        out.write(static_cast<const char*>(data[i]), sizes[i]);
+        written = header.sectionOffset[i] + sizes[i];
+    }
+    out.close();
+    if (!out || rename(tempFile.c_str(), snapshotFile.c_str()) != 0)
+    {
+        remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+//******************** MapSnapshot functions **********************************
+
+MapSnapshot::MapSnapshot()
+ : m_base(nullptr), m_length(0)
+{
+    memset(&m_arrays, 0, sizeof(m_arrays));
+}
+
+MapSnapshot::~MapSnapshot()
+{
+    close();
+}
+
+bool MapSnapshot::isSnapshotFile(const string& file)
+{
+    ifstream in(file, ios::binary);
+    char magic[sizeof(MAP_SNAPSHOT_MAGIC)];
+    if (!in.read(magic, sizeof(magic))) return false;
+    return memcmp(magic, MAP_SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+bool MapSnapshot::open(const string& file)
+{
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MapSnapshotHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (base == MAP_FAILED) return false;
+    m_base = base;
+    m_length = st.st_size;
+
+    // validate everything up front so lookups can trust the layout: the
+    // sections in order inside the file, then their contents (validArrays)
+    const MapSnapshotHeader& h = *static_cast<const MapSnapshotHeader*>(m_base);
+    const char* bytes = static_cast<const char*>(m_base);
+    bool ok = memcmp(h.magic, MAP_SNAPSHOT_MAGIC, sizeof(h.magic)) == 0
+        && h.version == MAP_SNAPSHOT_VERSION
+        && h.fileSize == m_length
+        && h.tableSize != 0 && (h.tableSize & (h.tableSize - 1)) == 0
+        && h.textSize != 0;
+    uint64_t sizes[SECTION_COUNT];
+    sectionSizes(h, sizes);
+    uint64_t end = sizeof(h);
+    for (int i = 0; ok && i < SECTION_COUNT; i++)
+    {
+        // compared against what is left of the file, so a huge offset cannot wrap around
+        ok = h.sectionOffset[i] >= end && h.sectionOffset[i] % 8 == 0
+            && h.sectionOffset[i] <= m_length && sizes[i] <= m_length - h.sectionOffset[i];
+        end = h.sectionOffset[i] + sizes[i];
+    }
+    if (ok)
+    {
+        m_arrays.nodeCount = h.nodeCount;
+        m_arrays.edgeCount = h.edgeCount;
+        m_arrays.nameCount = h.nameCount;
+        m_arrays.tableSize = h.tableSize;
+        m_arrays.textSize = h.textSize;
+        m_arrays.latitudes = reinterpret_cast<const double*>(bytes + h.sectionOffset[SECTION_LATITUDES]);
+        m_arrays.longitudes = reinterpret_cast<const double*>(bytes + h.sectionOffset[SECTION_LONGITUDES]);
+        m_arrays.coordText = reinterpret_cast<const uint32_t*>(bytes + h.sectionOffset[SECTION_COORD_TEXT]);
+        m_arrays.edgeOffsets = reinterpret_cast<const EdgeId*>(bytes + h.sectionOffset[SECTION_EDGE_OFFSETS]);
+        m_arrays.edgeTargets = reinterpret_cast<const NodeId*>(bytes + h.sectionOffset[SECTION_EDGE_TARGETS]);
+        m_arrays.edgeLengths = reinterpret_cast<const double*>(bytes + h.sectionOffset[SECTION_EDGE_LENGTHS]);
+        m_arrays.edgeNames = reinterpret_cast<const uint32_t*>(bytes + h.sectionOffset[SECTION_EDGE_NAMES]);
+        m_arrays.edgeTwins = reinterpret_cast<const EdgeId*>(bytes + h.sectionOffset[SECTION_EDGE_TWINS]);
+        m_arrays.nameText = reinterpret_cast<const uint32_t*>(bytes + h.sectionOffset[SECTION_NAME_TEXT]);
+        m_arrays.table = reinterpret_cast<const NodeId*>(bytes + h.sectionOffset[SECTION_TABLE]);
+        m_arrays.text = bytes + h.sectionOffset[SECTION_TEXT];
+        ok = validArrays(m_arrays);
+    }
+    if (!ok)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MapSnapshot::close()
+{
+    if (m_base != nullptr)
+        munmap(m_base, m_length);
+    m_base = nullptr;
+    m_length = 0;
+    memset(&m_arrays, 0, sizeof(m_arrays));
+}
+
+void MapSnapshot::swap(MapSnapshot& other)
+{
+    std::swap(m_base, other.m_base);
+    std::swap(m_length, other.m_length);
+    std::swap(m_arrays, other.m_arrays);
+}
+
+bool MapSnapshot::isOpen() const
+{
+    return m_base != nullptr;
+}
@@ -0,0 +1,72 @@
+#ifndef MAPSNAPSHOT_INCLUDED
+#define MAPSNAPSHOT_INCLUDED
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// MapSnapshot.h
+
+// A map snapshot is mapdata.txt compiled into a flat binary file that is
+// mmapped and used in place, so loading it costs about as much as mapping
+// the file.  After the header come the arrays of a StreetGraph, one section
+// per array in SnapshotSection order, each starting on an 8 byte boundary.
+//
+// Snapshots are written in host byte order; bump MAP_SNAPSHOT_VERSION whenever
+// the layout changes so stale files are rejected instead of misread.
+
+const char MAP_SNAPSHOT_MAGIC[8] = { 'F', 'D', 'M', 'A', 'P', 'S', 'N', 'P' };
+const uint32_t MAP_SNAPSHOT_VERSION = 3;
+
+enum SnapshotSection
+{
+    SECTION_LATITUDES, SECTION_LONGITUDES, SECTION_COORD_TEXT, SECTION_EDGE_OFFSETS,
+    SECTION_EDGE_TARGETS, SECTION_EDGE_LENGTHS, SECTION_EDGE_NAMES, SECTION_EDGE_TWINS,
+    SECTION_NAME_TEXT, SECTION_TABLE, SECTION_TEXT, SECTION_COUNT
+};
+
+struct MapSnapshotHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t nameCount;
+    uint32_t tableSize;
+    uint32_t textSize;
+    uint64_t fileSize;
+    uint64_t sectionOffset[SECTION_COUNT];
+};
+
+  // write graph as a snapshot file
+bool writeMapSnapshot(const StreetGraph& graph, const std::string& snapshotFile);
+
+  // compile a mapdata.txt file into a snapshot (defined in StreetMap.cpp)
+bool compileMapSnapshot(const std::string& mapFile, const std::string& snapshotFile);
+
+class MapSnapshot
+{
+public:
+    MapSnapshot();
+    ~MapSnapshot();
+    static bool isSnapshotFile(const std::string& file);
+    bool open(const std::string& file);
+    void close();
+    bool isOpen() const;
+      // trade mappings with other, so a snapshot can be opened aside and
+      // only replace this one once it has opened
+    void swap(MapSnapshot& other);
+      // views into the mapping, valid until close()
+    const StreetGraphArrays& arrays() const { return m_arrays; }
+      // We prevent a MapSnapshot object from being copied or assigned.
+    MapSnapshot(const MapSnapshot&) = delete;
+    MapSnapshot& operator=(const MapSnapshot&) = delete;
+private:
+    void*             m_base;
+    size_t            m_length;
+    StreetGraphArrays m_arrays;
+};
+
+#endif // MAPSNAPSHOT_INCLUDED
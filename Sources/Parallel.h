@@ -0,0 +1,44 @@
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Parallel.h
+
+  // number of threads to use when the caller does not say
+inline unsigned int defaultThreadCount()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+  // Run task(i) for every i in [0, count) on up to threads threads, the
+  // calling thread being one of them.  Indices are handed out one at a time,
+  // so uneven tasks still balance.  Returns when every task has finished.
+template<typename Task>
+void parallelFor(size_t count, unsigned int threads, const Task& task)
+{
+    if (threads > count) threads = (unsigned int)count;
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < count; )
+            task(i);
+    };
+    std::vector<std::thread> helpers;
+    for (unsigned int t = 1; t < threads; t++)
+        helpers.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < helpers.size(); t++)
+        helpers[t].join();
+}
+
+#endif // PARALLEL_INCLUDED
@@ -1,8 +1,18 @@
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "CellOverlay.h"
+#include "ChainGraph.h"
+#include "ContractionHierarchy.h"
+#include "IndexedHeap.h"
+#include "LandmarkTable.h"
+#include "SearchWorkspace.h"
+#include "StreetGraph.h"
+#include "ThreadPool.h"
 #include <list>
-#include <set>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include <iostream>
+#include <limits>
 using namespace std;
 
 class PointToPointRouterImpl
@@ -15,30 +25,64 @@ public:
         const GeoCoord& end,
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        vector<SegmentRef>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace) const;
+    void distanceMatrix(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets, vector<double>& miles,
+                        ThreadPool* pool) const;
+    DeliveryResult nearestTargets(const GeoCoord& source, const vector<GeoCoord>& targets, size_t k,
+                                  vector<pair<size_t, double>>& nearest) const;
+    size_t nodesExpanded() const;
+    void setSearchMode(SearchMode mode) { m_mode = mode; }
+    SearchMode searchMode() const { return m_mode; }
+    SearchWorkspace& workspace() const { return m_workspace; }
 private:
-    struct OrderedCoord {
-        OrderedCoord(GeoCoord coo) : coord(coo) {
-            f = 0;
-            g = 0;
-            h = 0;
-        };
-        double f, g, h;
-        GeoCoord coord;
-        
-        // compare OrderedCoord with f
-        bool operator<(const OrderedCoord& newCoord) const
-        {
-            return f < newCoord.f;
-        }
-    };
     const StreetMap* m_map;
-    ExpandableHashMap<GeoCoord, GeoCoord> locationOflastPointious;
+    mutable SearchWorkspace m_workspace; // for callers that bring none
+    SearchMode m_mode;
+
+    DeliveryResult routeOverGraph(NodeId startNode, NodeId endNode, SearchWorkspace& workspace,
+                                  vector<SegmentRef>& route, double& totalDistanceTravelled) const;
+    DeliveryResult routeOverChains(const ChainGraph& chains, NodeId startNode, NodeId endNode, SearchWorkspace& workspace,
+                                   vector<SegmentRef>& route, double& totalDistanceTravelled) const;
+    DeliveryResult routeBidirectional(NodeId startNode, NodeId endNode, SearchWorkspace& workspace,
+                                      vector<SegmentRef>& route, double& totalDistanceTravelled) const;
+    DeliveryResult routeOverHierarchy(const ContractionHierarchy& hierarchy, NodeId startNode, NodeId endNode,
+                                      SearchWorkspace& workspace,
+                                      vector<SegmentRef>& route, double& totalDistanceTravelled) const;
+      // begin workspace and mark the targets on the map on its backward side,
+      // each label's first counting the targets at that node; returns how many
+    uint32_t markTargets(const vector<NodeId>& targetNodes, SearchWorkspace& workspace) const;
+      // Dijkstra from source on the forward side of workspace until want of
+      // the marked targets are settled, or all that can be reached, and on
+      // through the nodes exactly as far as the last of those, so every
+      // target tied with it is settled too
+    void settleTargets(NodeId source, uint32_t want, SearchWorkspace& workspace) const;
 };
 
-PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm) : m_map(sm)
+  // A lower bound on the miles from v to t: the straight line, or what the
+  // landmarks prove when that is more.  Both are consistent, so their
+  // maximum is too, and A* with it stays exact.
+static double lowerBound(const StreetGraph& graph, const LandmarkTable* landmarks, NodeId v, NodeId t)
+{
+    double miles = distanceEarthMiles(graph.latitude(v), graph.longitude(v), graph.latitude(t), graph.longitude(t));
+    if (landmarks != nullptr)
+        miles = max(miles, landmarks->lowerBound(v, t));
+    return miles;
+}
+
+PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm) : m_map(sm), m_mode(SEARCH_UNIDIRECTIONAL)
 {
 }
 
+size_t PointToPointRouterImpl::nodesExpanded() const
+{
+    return m_workspace.nodesExpanded();
+}
+
 PointToPointRouterImpl::~PointToPointRouterImpl()
 {
 }
@@ -46,119 +90,464 @@ PointToPointRouterImpl::~PointToPointRouterImpl()
 DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
-        list<StreetSegment>& route,
-        double& totalDistanceTravelled) const
+        vector<SegmentRef>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace) const
 {
-    if (start == end)
+    route.clear();
+    totalDistanceTravelled = 0.0;
+    const StreetGraph& graph = m_map->graph();
+    NodeId startNode = graph.findNode(start);
+    NodeId endNode = graph.findNode(end);
+    if (startNode == NO_NODE || endNode == NO_NODE) return BAD_COORD; // not on the map, bad coord!
+    workspace.begin(graph.nodeCount()); // the last search's labels are stale from here on
+    if (startNode == endNode) return DELIVERY_SUCCESS;
+    const CellOverlay* overlay = m_map->overlay();
+    if (overlay != nullptr)
     {
-        route.clear();
-        totalDistanceTravelled = 0.0;
+        // the cheapest route under the traffic current now, which this
+        // query holds on to even if new traffic is applied meanwhile
+        shared_ptr<const CellOverlay::Metric> metric = overlay->metric();
+        double cost;
+        if (!overlay->route(*metric, startNode, endNode, workspace, route, cost)) return NO_ROUTE;
+        for (const SegmentRef& seg : route)
+            totalDistanceTravelled += seg.length();
         return DELIVERY_SUCCESS;
     }
-    route.clear();
-    totalDistanceTravelled = 0.0;
-    
-    set<OrderedCoord> open; // I care about order for open, so used set.
-    list<OrderedCoord> closed; // slower if ordered for closed, so used list.
-    
-    ExpandableHashMap<GeoCoord, GeoCoord> visited; // keep track of lastPointiously visited segments
-           
-    OrderedCoord startingPoint(start);
-    open.insert(startingPoint);
-    vector<StreetSegment> segments;
-    
+    const ContractionHierarchy* hierarchy = m_map->hierarchy();
+    if (hierarchy != nullptr)
+        return routeOverHierarchy(*hierarchy, startNode, endNode, workspace, route, totalDistanceTravelled);
+    if (m_mode == SEARCH_BIDIRECTIONAL)
+        return routeBidirectional(startNode, endNode, workspace, route, totalDistanceTravelled);
+    const ChainGraph* chains = m_map->chainGraph();
+    if (chains != nullptr)
+        return routeOverChains(*chains, startNode, endNode, workspace, route, totalDistanceTravelled);
+    return routeOverGraph(startNode, endNode, workspace, route, totalDistanceTravelled);
+}
+
+DeliveryResult PointToPointRouterImpl::routeOverGraph(NodeId startNode, NodeId endNode, SearchWorkspace& workspace,
+                                                      vector<SegmentRef>& route, double& totalDistanceTravelled) const
+{
+    // A* over the full graph.  Every node is unseen, open (in the heap, at
+    // its best f so far) or closed; a shorter way to an open node lowers its
+    // key in place, so each node is expanded at most once.
+    const StreetGraph& graph = m_map->graph();
+    const LandmarkTable* landmarks = m_map->landmarks();
+    SearchSide& search = workspace.forward();
+    IndexedHeap& open = search.open();
+
+    search.label(startNode).g = 0;
+    open.pushOrDecrease(startNode, 0);
+
     while (!open.empty())
     {
-        OrderedCoord currPoint = *(open.begin());
-        auto popOff = open.begin();
-        open.erase(popOff); // remove first element from open list
-        
-        closed.push_back(currPoint); // mark currPoint as visited and expanded.
-        
-        if (currPoint.coord.latitudeText == end.latitudeText && currPoint.coord.longitudeText == end.longitudeText) // check if we're at the end coordinate
+        NodeId curr = open.pop();
+        SearchLabel& here = search.label(curr);
+        here.closed = true;
+        workspace.countExpanded();
+
+        if (curr == endNode) // check if we're at the end coordinate
         {
-            for (;;)
-            {
-                if (currPoint.coord == start) break;
-                GeoCoord* lastPoint = visited.find(currPoint.coord);
-                if (lastPoint == nullptr) return BAD_COORD; // if the point has not been visited, bad coord!
-                m_map->getSegmentsThatStartWith(*lastPoint, segments);
-                
-                auto it = segments.begin();
-                while (it != segments.end())
-                {
-                    if ((*it).end != currPoint.coord)
-                    {
-                        it++;
-                        continue;
-                    }
-                        
-                    //create a street segment to push to our route
-                    string streetName = (*it).name;
-                    StreetSegment currSeg(*lastPoint, currPoint.coord, streetName);
-                    
-                    // push front to get proper order. push_back makes reverse order.
-                    route.push_front(currSeg);
-                    
-                    // add this distance to the total
-                    totalDistanceTravelled += distanceEarthMiles(*lastPoint, currPoint.coord);
-                    it++;
-                }
-                currPoint = *(lastPoint);
-            }
+            // each node remembers the edge it was reached by: no searching
+            for (NodeId child = endNode; child != startNode; child = search.parent(child))
+                route.push_back(SegmentRef(&graph, search.parent(child), search.edge(child)));
+            reverse(route.begin(), route.end()); // we walked back from the end, so flip it
+            totalDistanceTravelled = here.g;
             return DELIVERY_SUCCESS;
         }
-        
-        // get any associated segments
-        m_map->getSegmentsThatStartWith(currPoint.coord, segments);
-        if (segments.empty()) return BAD_COORD; // if there's no segments found, bad coord!
-            
-        auto it = segments.begin();
-        while (it != segments.end())
+
+        // expand every edge leaving the current node
+        for (EdgeId e = graph.edgeBegin(curr); e < graph.edgeEnd(curr); e++)
         {
-            bool inList = false;
-            auto closedIterator = closed.begin();
-            while (closedIterator != closed.end())
+            NodeId child = graph.edgeTarget(e);
+            double distance = here.g + graph.edgeLength(e);
+            if (search.closed(child) || distance >= search.g(child)) continue;
+            SearchLabel& reached = search.label(child);
+            reached.g = distance;
+            reached.parent = curr;
+            reached.edge = e;
+            // h never overestimates the distance from child to end, so the
+            // first time end is popped its g is shortest
+            open.pushOrDecrease(child, distance + lowerBound(graph, landmarks, child, endNode));
+        }
+    }
+    return NO_ROUTE;
+}
+
+DeliveryResult PointToPointRouterImpl::routeOverChains(const ChainGraph& chains, NodeId startNode, NodeId endNode,
+                                                       SearchWorkspace& workspace,
+                                                       vector<SegmentRef>& route, double& totalDistanceTravelled) const
+{
+    // A* over junctions, each step a whole chain.  An interior start sets
+    // off along the rest of its two chains, and an interior end is reached
+    // from the start of either chain through it.  A label's first and last
+    // are the steps it was last reached by.
+    const StreetGraph& graph = chains.graph();
+    double endLat = graph.latitude(endNode), endLon = graph.longitude(endNode);
+    SearchSide& search = workspace.forward();
+    IndexedHeap& open = search.open();
+
+    auto stepsLength = [&](uint32_t first, uint32_t last) {
+        double length = 0;
+        for (uint32_t i = first; i < last; i++)
+            length += graph.edgeLength(chains.step(i).edge);
+        return length;
+    };
+    auto relax = [&](NodeId to, double distance, uint32_t first, uint32_t last) {
+        if (search.closed(to) || distance >= search.g(to)) return;
+        SearchLabel& reached = search.label(to);
+        reached.g = distance;
+        reached.first = first;
+        reached.last = last;
+        open.pushOrDecrease(to, distance + distanceEarthMiles(graph.latitude(to), graph.longitude(to), endLat, endLon));
+    };
+      // the part of a chain leaving junction from that leads to an interior end
+    auto relaxEnd = [&](NodeId from) {
+        for (int which = 0; which < 2 && !chains.isJunction(endNode); which++)
+        {
+            const ChainGraph::Through& t = chains.through(endNode, which);
+            if (t.chain >= chains.chainBegin(from) && t.chain < chains.chainEnd(from))
             {
-                if ((*it).end == (*closedIterator).coord)
-                {
-                    inList = true;
-                    break;
-                }
-                closedIterator++;
+                uint32_t first = chains.firstStep(t.chain);
+                relax(endNode, search.g(from) + stepsLength(first, t.at), first, t.at);
             }
-            if (inList)
+        }
+    };
+
+    search.label(startNode).g = 0;
+    if (chains.isJunction(startNode))
+        open.pushOrDecrease(startNode, 0);
+    else
+    {
+        search.label(startNode).closed = true;
+        for (int which = 0; which < 2; which++)
+        {
+            const ChainGraph::Through& t = chains.through(startNode, which);
+            uint32_t last = chains.lastStep(t.chain);
+            relax(chains.chainTarget(t.chain), stepsLength(t.at, last), t.at, last);
+            for (int endWhich = 0; endWhich < 2 && !chains.isJunction(endNode); endWhich++)
             {
-                it++;
-                continue;
+                const ChainGraph::Through& te = chains.through(endNode, endWhich);
+                if (te.chain == t.chain && te.at > t.at) // further along the same chain
+                    relax(endNode, stepsLength(t.at, te.at), t.at, te.at);
             }
-            OrderedCoord childOfCurr((*it).end); //create a child based on current iterator's end
-            
-            visited.associate(childOfCurr.coord, currPoint.coord);
-            
-            childOfCurr.g = currPoint.g + distanceEarthMiles(currPoint.coord, childOfCurr.coord);
-            // g of child is the current point's g as well as distance from currpoint to child coord
-            childOfCurr.h = distanceEarthMiles(childOfCurr.coord, end); // h is distance from child to end
-            childOfCurr.f = childOfCurr.g + childOfCurr.h;
-
-            auto openIterator = open.begin();
-            while (openIterator != open.end())
+        }
+    }
+
+    while (!open.empty())
+    {
+        NodeId curr = open.pop();
+        search.label(curr).closed = true;
+        workspace.countExpanded();
+        if (curr == endNode)
+        {
+            for (NodeId child = endNode; child != startNode; )
             {
-                if (childOfCurr.g > (*openIterator).g  && childOfCurr.coord == (*openIterator).coord)
+                const SearchLabel& reached = search.label(child);
+                for (uint32_t i = reached.last; i-- > reached.first; )
                 {
-                    inList = true;
-                    break;
+                    route.push_back(chains.segment(i));
+                    totalDistanceTravelled += route.back().length();
                 }
-                openIterator++;
+                child = chains.step(reached.first).from;
             }
-
-            if (!inList) open.insert(childOfCurr); //insert the generated child into the open list to expand
-            it++;
+            reverse(route.begin(), route.end()); // we walked back from the end, so flip it
+            return DELIVERY_SUCCESS;
         }
+        for (ChainId c = chains.chainBegin(curr); c < chains.chainEnd(curr); c++)
+            relax(chains.chainTarget(c), search.g(curr) + chains.chainLength(c), chains.firstStep(c), chains.lastStep(c));
+        relaxEnd(curr);
     }
     return NO_ROUTE;
 }
 
+DeliveryResult PointToPointRouterImpl::routeBidirectional(NodeId startNode, NodeId endNode, SearchWorkspace& workspace,
+                                                          vector<SegmentRef>& route, double& totalDistanceTravelled) const
+{
+    // A* forward from start and backward from end at the same time, the side
+    // with fewer open nodes expanding next so the two grow evenly.  They
+    // share the average potential p(v) = (h(v, end) - h(start, v)) / 2,
+    // forward with +p and backward with -p, so both see the same nonnegative
+    // reduced segment lengths; that lets them stop as soon as their smallest
+    // keys add up to the shortest route through a node both have reached.
+    // The parser adds every segment in both directions, so the backward
+    // search can follow the segments leaving a node.  A label's parent is
+    // the node it was reached from: towards start, or towards end.
+    const StreetGraph& graph = m_map->graph();
+    const LandmarkTable* landmarks = m_map->landmarks();
+    auto potential = [&](NodeId v) {
+        return (lowerBound(graph, landmarks, v, endNode) - lowerBound(graph, landmarks, v, startNode)) / 2;
+    };
+
+    SearchSide& forward = workspace.forward();
+    SearchSide& backward = workspace.backward();
+    forward.label(startNode).g = 0;
+    forward.open().pushOrDecrease(startNode, potential(startNode));
+    backward.label(endNode).g = 0;
+    backward.open().pushOrDecrease(endNode, -potential(endNode));
+
+    double best = numeric_limits<double>::infinity();
+    NodeId meet = NO_NODE; // the node in the middle of the best route so far
+    while (!forward.open().empty() && !backward.open().empty() &&
+           forward.open().topKey() + backward.open().topKey() < best)
+    {
+        bool forwards = forward.open().size() <= backward.open().size();
+        SearchSide& side = forwards ? forward : backward;
+        SearchSide& other = forwards ? backward : forward;
+        double sign = forwards ? 1 : -1; // of the potential
+        NodeId curr = side.open().pop();
+        SearchLabel& here = side.label(curr);
+        here.closed = true;
+        workspace.countExpanded();
+        for (EdgeId e = graph.edgeBegin(curr); e < graph.edgeEnd(curr); e++)
+        {
+            // the edge the route takes: e, or going backward the one from child back to curr
+            EdgeId taken = forwards ? e : graph.reverseEdge(e);
+            if (taken == NO_EDGE) continue; // a one-way segment, not usable backward
+            NodeId child = graph.edgeTarget(e);
+            double distance = here.g + graph.edgeLength(taken);
+            if (side.closed(child) || distance >= side.g(child)) continue;
+            SearchLabel& reached = side.label(child);
+            reached.g = distance;
+            reached.parent = curr;
+            reached.edge = taken;
+            side.open().pushOrDecrease(child, distance + sign * potential(child));
+            if (distance + other.g(child) < best)
+            {
+                best = distance + other.g(child);
+                meet = child;
+            }
+        }
+    }
+    if (meet == NO_NODE) return NO_ROUTE;
+
+    // from meet back to start by the edges the forward search took, flipped,
+    // then on from meet to end by those the backward search recorded
+    for (NodeId child = meet; child != startNode; child = forward.parent(child))
+        route.push_back(SegmentRef(&graph, forward.parent(child), forward.edge(child)));
+    reverse(route.begin(), route.end());
+    for (NodeId v = meet; v != endNode; v = backward.parent(v))
+        route.push_back(SegmentRef(&graph, v, backward.edge(v)));
+    for (const SegmentRef& seg : route)
+        totalDistanceTravelled += seg.length();
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult PointToPointRouterImpl::routeOverHierarchy(const ContractionHierarchy& hierarchy, NodeId startNode, NodeId endNode,
+                                                          SearchWorkspace& workspace,
+                                                          vector<SegmentRef>& route, double& totalDistanceTravelled) const
+{
+    // Dijkstra upwards from start and upwards from end, over the arcs of the
+    // hierarchy only.  The shortest route climbs from both ends to its
+    // highest node, so it is the best meeting of the two searches; each side
+    // can stop once its smallest distance is no better than that meeting.
+    // A label's parent is the node below, and first the arc that climbed from it.
+    SearchSide& forward = workspace.forward();
+    SearchSide& backward = workspace.backward();
+    forward.label(startNode).g = 0;
+    forward.open().pushOrDecrease(startNode, 0);
+    backward.label(endNode).g = 0;
+    backward.open().pushOrDecrease(endNode, 0);
+
+    double best = numeric_limits<double>::infinity();
+    NodeId meet = NO_NODE;
+    for (;;)
+    {
+        bool forwardDone = forward.open().empty() || forward.open().topKey() >= best;
+        bool backwardDone = backward.open().empty() || backward.open().topKey() >= best;
+        if (forwardDone && backwardDone) break;
+        bool forwards = backwardDone || (!forwardDone && forward.open().topKey() <= backward.open().topKey());
+        SearchSide& side = forwards ? forward : backward;
+        SearchSide& other = forwards ? backward : forward;
+        NodeId curr = side.open().pop();
+        workspace.countExpanded();
+        double here = side.g(curr);
+        if (here + other.g(curr) < best)
+        {
+            best = here + other.g(curr);
+            meet = curr;
+        }
+        for (uint32_t i = hierarchy.arcBegin(curr); i < hierarchy.arcEnd(curr); i++)
+        {
+            const ContractionHierarchy::Arc& a = hierarchy.arc(i);
+            double distance = here + a.length;
+            if (distance >= side.g(a.target)) continue;
+            SearchLabel& reached = side.label(a.target);
+            reached.g = distance;
+            reached.parent = curr;
+            reached.first = i;
+            side.open().pushOrDecrease(a.target, distance);
+        }
+    }
+    if (meet == NO_NODE) return NO_ROUTE;
+
+    // the arcs from start up to meet, then from meet down to end, each
+    // unpacked into the segments it stands for
+    for (NodeId child = meet; child != startNode; child = forward.parent(child))
+    {
+        size_t first = route.size();
+        hierarchy.unpack(forward.parent(child), forward.label(child).first, false, route);
+        reverse(route.begin() + first, route.end()); // undone with the rest below
+    }
+    reverse(route.begin(), route.end());
+    for (NodeId parent = meet; parent != endNode; parent = backward.parent(parent))
+        hierarchy.unpack(backward.parent(parent), backward.label(parent).first, true, route);
+    for (const SegmentRef& seg : route)
+        totalDistanceTravelled += seg.length();
+    return DELIVERY_SUCCESS;
+}
+
+uint32_t PointToPointRouterImpl::markTargets(const vector<NodeId>& targetNodes, SearchWorkspace& workspace) const
+{
+    workspace.begin(m_map->graph().nodeCount());
+    uint32_t marked = 0;
+    for (NodeId t : targetNodes)
+    {
+        if (t == NO_NODE) continue;
+        SearchLabel& target = workspace.backward().label(t);
+        target.marked = true;
+        target.first++; // one more target at this node
+        marked++;
+    }
+    return marked;
+}
+
+void PointToPointRouterImpl::settleTargets(NodeId source, uint32_t want, SearchWorkspace& workspace) const
+{
+    const StreetGraph& graph = m_map->graph();
+    SearchSide& search = workspace.forward();
+    SearchSide& targets = workspace.backward();
+    search.begin(graph.nodeCount());
+    IndexedHeap& open = search.open();
+    search.label(source).g = 0;
+    open.pushOrDecrease(source, 0);
+    uint32_t settled = 0;
+    double enough = -1; // the miles at which want targets were settled
+    while (!open.empty() && (settled < want || open.topKey() == enough))
+    {
+        NodeId curr = open.pop();
+        SearchLabel& here = search.label(curr);
+        here.closed = true;
+        workspace.countExpanded();
+        if (targets.marked(curr) && settled < want)
+        {
+            settled += targets.label(curr).first;
+            if (settled >= want) enough = here.g;
+        }
+        for (EdgeId e = graph.edgeBegin(curr); e < graph.edgeEnd(curr); e++)
+        {
+            NodeId child = graph.edgeTarget(e);
+            double distance = here.g + graph.edgeLength(e);
+            if (search.closed(child) || distance >= search.g(child)) continue;
+            search.label(child).g = distance;
+            open.pushOrDecrease(child, distance);
+        }
+    }
+}
+
+void PointToPointRouterImpl::distanceMatrix(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                                            vector<double>& miles, ThreadPool* pool) const
+{
+    // Dijkstra from each source until every target on the map is settled.
+    // The targets are marked on the backward side of a workspace, which no
+    // row touches; each row starts the forward side afresh.
+    const StreetGraph& graph = m_map->graph();
+    size_t columns = targets.size();
+    miles.assign(sources.size() * columns, numeric_limits<double>::infinity());
+    m_workspace.begin(graph.nodeCount());
+    if (columns == 0) return;
+
+    vector<NodeId> targetNodes;
+    for (const GeoCoord& gc : targets)
+        targetNodes.push_back(graph.findNode(gc));
+    uint32_t targetCount = markTargets(targetNodes, m_workspace); // those on the map
+    auto row = [&](size_t r, SearchWorkspace& workspace) {
+        NodeId source = graph.findNode(sources[r]);
+        if (source == NO_NODE) return;
+        settleTargets(source, targetCount, workspace);
+        const SearchSide& search = workspace.forward();
+        for (size_t column = 0; column < columns; column++)
+        {
+            NodeId t = targetNodes[column];
+            if (t != NO_NODE && search.closed(t))
+                miles[r * columns + column] = search.g(t);
+        }
+    };
+
+    if (pool == nullptr || pool->threadCount() <= 1 || sources.size() <= 1)
+    {
+        for (size_t r = 0; r < sources.size(); r++)
+            row(r, m_workspace);
+        return;
+    }
+    // one row per task, each thread with a workspace of its own (the
+    // caller's is this router's) and writing only its own row
+    vector<unique_ptr<SearchWorkspace>> workspaces(pool->threadCount());
+    pool->parallelFor(sources.size(), [&](size_t r, unsigned int thread) {
+        SearchWorkspace* workspace = &m_workspace;
+        if (thread != 0)
+        {
+            if (workspaces[thread] == nullptr)
+            {
+                workspaces[thread].reset(new SearchWorkspace);
+                markTargets(targetNodes, *workspaces[thread]);
+            }
+            workspace = workspaces[thread].get();
+        }
+        row(r, *workspace);
+    });
+    for (const auto& workspace : workspaces)
+    {
+        if (workspace != nullptr)
+            m_workspace.countExpanded(workspace->nodesExpanded());
+    }
+}
+
+DeliveryResult PointToPointRouterImpl::nearestTargets(const GeoCoord& source, const vector<GeoCoord>& targets, size_t k,
+                                                      vector<pair<size_t, double>>& nearest) const
+{
+    // one Dijkstra from source, stopping once k of the targets are settled;
+    // settled nodes come off the heap nearest first, so those are the k nearest
+    nearest.clear();
+    const StreetGraph& graph = m_map->graph();
+    NodeId sourceNode = graph.findNode(source);
+    if (sourceNode == NO_NODE) return BAD_COORD;
+    vector<NodeId> targetNodes;
+    for (const GeoCoord& gc : targets)
+        targetNodes.push_back(graph.findNode(gc));
+    uint32_t targetCount = markTargets(targetNodes, m_workspace);
+    if (k == 0 || k > targetCount) k = targetCount;
+    settleTargets(sourceNode, (uint32_t)k, m_workspace);
+
+    const SearchSide& search = m_workspace.forward();
+    for (size_t i = 0; i < targetNodes.size(); i++)
+    {
+        if (targetNodes[i] != NO_NODE && search.closed(targetNodes[i]))
+            nearest.push_back(make_pair(i, search.g(targetNodes[i])));
+    }
+    // by miles, ties in the order given; more than k may have been settled
+    // when several tie for the k-th place
+    stable_sort(nearest.begin(), nearest.end(), [](const pair<size_t, double>& a, const pair<size_t, double>& b) {
+        return a.second < b.second;
+    });
+    if (nearest.size() > k) nearest.resize(k);
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled) const
+{
+    vector<SegmentRef> segments;
+    DeliveryResult result = generatePointToPointRoute(start, end, segments, totalDistanceTravelled, m_workspace);
+    route.clear();
+    for (const SegmentRef& seg : segments) // only the returned route is copied out of the map
+        route.push_back(seg.toStreetSegment());
+    return result;
+}
+
 //******************** PointToPointRouter functions ***************************
 
 // These functions simply delegate to PointToPointRouterImpl's functions.
@@ -182,3 +571,49 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
 {
     return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
 }
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        vector<SegmentRef>& route,
+        double& totalDistanceTravelled) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, m_impl->workspace());
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        vector<SegmentRef>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, workspace);
+}
+
+void PointToPointRouter::distanceMatrix(const vector<GeoCoord>& sources, const vector<GeoCoord>& targets,
+                                        vector<double>& miles, ThreadPool* pool) const
+{
+    m_impl->distanceMatrix(sources, targets, miles, pool);
+}
+
+DeliveryResult PointToPointRouter::nearestTargets(const GeoCoord& source, const vector<GeoCoord>& targets, size_t k,
+                                                  vector<pair<size_t, double>>& nearest) const
+{
+    return m_impl->nearestTargets(source, targets, k, nearest);
+}
+
+size_t PointToPointRouter::nodesExpanded() const
+{
+    return m_impl->nodesExpanded();
+}
+
+void PointToPointRouter::setSearchMode(SearchMode mode)
+{
+    m_impl->setSearchMode(mode);
+}
+
+SearchMode PointToPointRouter::searchMode() const
+{
+    return m_impl->searchMode();
+}
@@ -0,0 +1,111 @@
+#include "RouteCache.h"
+using namespace std;
+
+unsigned int hasher(const RouteKey& k)
+{
+    return (unsigned int)(k.start * 2654435761u) ^ k.end;
+}
+
+RouteCache::RouteCache(const StreetMap* map, size_t capacity)
+ : m_map(map), m_capacity(capacity > 0 ? capacity : 1), m_generation(map->generation()),
+   m_hits(0), m_misses(0), m_evictions(0), m_invalidations(0)
+{
+}
+
+bool RouteCache::find(NodeId start, NodeId end, vector<SegmentRef>& route, double& distance, DeliveryResult& result)
+{
+    lock_guard<mutex> hold(m_lock);
+    checkGeneration();
+    RouteKey key = { start, end };
+    LegIterator* found = m_index.find(key);
+    if (found == nullptr)
+    {
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    m_legs.splice(m_legs.begin(), m_legs, *found); // now the most recently used
+    const Leg& leg = m_legs.front();
+    route = leg.route;
+    distance = leg.distance;
+    result = leg.result;
+    return true;
+}
+
+void RouteCache::store(NodeId start, NodeId end, const vector<SegmentRef>& route, double distance, DeliveryResult result,
+                       unsigned long generation)
+{
+    lock_guard<mutex> hold(m_lock);
+    checkGeneration();
+    if (generation != m_generation) return; // routed over a map that has changed since
+    RouteKey key = { start, end };
+    LegIterator* found = m_index.find(key);
+    if (found != nullptr) // another planner routed it meanwhile
+    {
+        m_legs.splice(m_legs.begin(), m_legs, *found);
+        return;
+    }
+    if (m_legs.size() >= m_capacity)
+    {
+        m_index.remove(m_legs.back().key);
+        m_legs.pop_back();
+        m_evictions++;
+    }
+    Leg leg = { key, result, distance, route };
+    m_legs.push_front(leg);
+    m_index.associate(key, m_legs.begin());
+}
+
+void RouteCache::clear()
+{
+    lock_guard<mutex> hold(m_lock);
+    dropAll();
+    m_generation = m_map->generation();
+}
+
+size_t RouteCache::size() const
+{
+    lock_guard<mutex> hold(m_lock);
+    return m_legs.size();
+}
+
+size_t RouteCache::hits() const
+{
+    lock_guard<mutex> hold(m_lock);
+    return m_hits;
+}
+
+size_t RouteCache::misses() const
+{
+    lock_guard<mutex> hold(m_lock);
+    return m_misses;
+}
+
+size_t RouteCache::evictions() const
+{
+    lock_guard<mutex> hold(m_lock);
+    return m_evictions;
+}
+
+size_t RouteCache::invalidations() const
+{
+    lock_guard<mutex> hold(m_lock);
+    return m_invalidations;
+}
+
+// PRIVATE MEMBER FUNCTIONS
+
+void RouteCache::checkGeneration()
+{
+    unsigned long generation = m_map->generation();
+    if (generation == m_generation) return;
+    dropAll();
+    m_generation = generation;
+    m_invalidations++;
+}
+
+void RouteCache::dropAll()
+{
+    m_legs.clear();
+    m_index.reset();
+}
@@ -0,0 +1,86 @@
+#ifndef ROUTECACHE_INCLUDED
+#define ROUTECACHE_INCLUDED
+
+#include "provided.h"
+#include "ExpandableHashMap.h"
+#include "StreetGraph.h"
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <vector>
+
+// RouteCache.h
+
+// A bounded cache of point-to-point legs, for planners that keep routing
+// between the same depot and buildings.  Each entry is keyed by the start and
+// end nodes and holds the router's result, distance and segments (as
+// SegmentRefs into the map, so an entry costs a few bytes per segment).  Once
+// full, the least recently used leg makes room for the next.
+//
+// One lock guards the whole cache, so planners on any number of threads can
+// share it; a hit only copies the segment list out.  Entries point into the
+// StreetMap, so the cache compares the map's generation() on every call and
+// empties itself the first time it sees the map has been loaded again (or
+// re-weighted by traffic).  A leg is stored with the generation it was
+// routed under, so one that was still being routed when the map changed is
+// not kept.
+
+struct RouteKey
+{
+    NodeId start;
+    NodeId end;
+    bool operator==(const RouteKey& other) const { return start == other.start && end == other.end; }
+};
+
+class RouteCache
+{
+public:
+      // cache up to capacity legs routed over map
+    RouteCache(const StreetMap* map, size_t capacity = 1024);
+    const StreetMap* map() const { return m_map; }
+
+      // the cached leg from start to end, if there is one
+    bool find(NodeId start, NodeId end, std::vector<SegmentRef>& route, double& distance, DeliveryResult& result);
+      // remember a leg just routed, generation being the map's generation()
+      // read before routing it; a leg routed over an older map is dropped
+    void store(NodeId start, NodeId end, const std::vector<SegmentRef>& route, double distance, DeliveryResult result,
+               unsigned long generation);
+    void clear();
+
+    size_t size() const;
+    size_t capacity() const { return m_capacity; }
+    size_t hits() const;
+    size_t misses() const;
+    size_t evictions() const;
+      // times the cache emptied itself because the map was loaded again
+    size_t invalidations() const;
+
+    RouteCache(const RouteCache&) = delete;
+    RouteCache& operator=(const RouteCache&) = delete;
+private:
+    struct Leg
+    {
+        RouteKey key;
+        DeliveryResult result;
+        double distance;
+        std::vector<SegmentRef> route;
+    };
+    typedef std::list<Leg>::iterator LegIterator;
+
+    const StreetMap* m_map;
+    size_t m_capacity;
+    mutable std::mutex m_lock;
+    unsigned long m_generation;  // of the map the entries came from
+    std::list<Leg> m_legs;       // most recently used first
+    ExpandableHashMap<RouteKey, LegIterator> m_index;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_evictions;
+    size_t m_invalidations;
+
+      // with m_lock held: drop everything if the map has been reloaded
+    void checkGeneration();
+    void dropAll();
+};
+
+#endif // ROUTECACHE_INCLUDED
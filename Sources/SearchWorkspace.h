@@ -0,0 +1,112 @@
+#ifndef SEARCHWORKSPACE_INCLUDED
+#define SEARCHWORKSPACE_INCLUDED
+
+#include "IndexedHeap.h"
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// SearchWorkspace.h
+
+// What a route search keeps about each node, sized once for the graph and
+// reused by every search after.  Each label carries the stamp of the search
+// that wrote it, and a label with an older stamp reads as untouched, so
+// starting a search only bumps the stamp: no array is cleared or allocated,
+// however large the map.  (When the stamp wraps, every label is put back once.)
+//
+// A workspace has two sides, forward and backward, each with its labels and
+// its open heap, for the searches that grow from both ends.  One belongs to
+// each PointToPointRouter; a thread that brings its own can share a router
+// with other threads, since the router itself then changes nothing.
+
+struct SearchLabel
+{
+    double   g;       // miles from the side's source, infinity until reached
+    NodeId   parent;  // the node it was reached from
+    EdgeId   edge;    // the edge it was reached by, leaving parent (on a
+                      //   backward side, the one from it back to parent)
+    uint32_t first;   // how it was reached, in the search's own terms (chain
+    uint32_t last;    //   steps, a hierarchy arc); 0 until set
+    uint32_t stamp;   // the search these values belong to
+    bool     closed;  // expanded already
+    bool     marked;  // a flag for the search's own use (the targets of a matrix)
+};
+
+class SearchSide
+{
+public:
+    SearchSide() : m_stamp(0) {}
+      // forget the last search: every label untouched and the heap empty
+    void begin(uint32_t nodeCount)
+    {
+        if (m_labels.size() != nodeCount)
+            m_labels.assign(nodeCount, untouched(0));
+        if (++m_stamp == 0)
+        {
+            for (SearchLabel& l : m_labels)
+                l.stamp = 0;
+            m_stamp = 1;
+        }
+        m_open.reset(nodeCount);
+    }
+
+    double g(NodeId v) const { return current(v) ? m_labels[v].g : std::numeric_limits<double>::infinity(); }
+    NodeId parent(NodeId v) const { return current(v) ? m_labels[v].parent : NO_NODE; }
+    EdgeId edge(NodeId v) const { return m_labels[v].edge; }  // only once v is reached
+    bool closed(NodeId v) const { return current(v) && m_labels[v].closed; }
+    bool marked(NodeId v) const { return current(v) && m_labels[v].marked; }
+      // v's label to write to, untouched if this search has not written it yet
+    SearchLabel& label(NodeId v)
+    {
+        SearchLabel& l = m_labels[v];
+        if (l.stamp != m_stamp)
+            l = untouched(m_stamp);
+        return l;
+    }
+    IndexedHeap& open() { return m_open; }
+
+    size_t memoryUsage() const { return m_labels.capacity() * sizeof(SearchLabel); }
+private:
+    std::vector<SearchLabel> m_labels;
+    uint32_t m_stamp;  // of the current search
+    IndexedHeap m_open;
+
+    bool current(NodeId v) const { return m_labels[v].stamp == m_stamp; }
+    static SearchLabel untouched(uint32_t stamp)
+    {
+        SearchLabel l = { std::numeric_limits<double>::infinity(), NO_NODE, 0, 0, 0, stamp, false, false };
+        return l;
+    }
+};
+
+class SearchWorkspace
+{
+public:
+    SearchWorkspace() : m_expanded(0) {}
+      // ready for a new search over nodeCount nodes, counting expansions from zero
+    void begin(uint32_t nodeCount)
+    {
+        m_forward.begin(nodeCount);
+        m_backward.begin(nodeCount);
+        m_expanded = 0;
+    }
+    SearchSide& forward() { return m_forward; }
+    SearchSide& backward() { return m_backward; }
+
+    void countExpanded(size_t count = 1) { m_expanded += count; }
+      // nodes taken off the open heaps since begin
+    size_t nodesExpanded() const { return m_expanded; }
+      // bytes held for labels
+    size_t memoryUsage() const { return m_forward.memoryUsage() + m_backward.memoryUsage(); }
+
+    SearchWorkspace(const SearchWorkspace&) = delete;
+    SearchWorkspace& operator=(const SearchWorkspace&) = delete;
+private:
+    SearchSide m_forward;
+    SearchSide m_backward;
+    size_t m_expanded;
+};
+
+#endif // SEARCHWORKSPACE_INCLUDED
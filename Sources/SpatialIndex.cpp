@@ -0,0 +1,239 @@
+#include "SpatialIndex.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+static const double MILES_PER_DEGREE = deg2rad(1) * 6371.0 / 1.609344; // the radius distanceEarthMiles uses
+static const size_t NODES_PER_CELL = 2;
+
+SpatialIndex::SpatialIndex()
+ : m_graph(nullptr), m_lonScale(0), m_minX(0), m_minY(0), m_cellSize(1), m_columns(0), m_rows(0)
+{
+}
+
+void SpatialIndex::clear()
+{
+    m_graph = nullptr;
+    m_columns = m_rows = 0;
+    m_nodeStart.clear();
+    m_nodes.clear();
+    m_segmentStart.clear();
+    m_segments.clear();
+}
+
+double SpatialIndex::y(double latitude)
+{
+    return latitude * MILES_PER_DEGREE;
+}
+
+int SpatialIndex::column(double px) const
+{
+    double c = floor((px - m_minX) / m_cellSize);
+    return c < 0 ? 0 : c >= m_columns ? m_columns - 1 : (int)c;
+}
+
+int SpatialIndex::row(double py) const
+{
+    double r = floor((py - m_minY) / m_cellSize);
+    return r < 0 ? 0 : r >= m_rows ? m_rows - 1 : (int)r;
+}
+
+void SpatialIndex::build(const StreetGraph& graph)
+{
+    clear();
+    m_graph = &graph;
+    uint32_t n = graph.nodeCount();
+    if (n == 0) return;
+
+    double minLat = graph.latitude(0), maxLat = minLat;
+    double minLon = graph.longitude(0), maxLon = minLon;
+    for (NodeId i = 1; i < n; i++)
+    {
+        minLat = min(minLat, graph.latitude(i));
+        maxLat = max(maxLat, graph.latitude(i));
+        minLon = min(minLon, graph.longitude(i));
+        maxLon = max(maxLon, graph.longitude(i));
+    }
+    m_lonScale = MILES_PER_DEGREE * cos(deg2rad((minLat + maxLat) / 2));
+    m_minX = x(minLon);
+    m_minY = y(minLat);
+    double width = x(maxLon) - m_minX;
+    double height = y(maxLat) - m_minY;
+
+    // square cells holding NODES_PER_CELL nodes on average, but never more
+    // cells along one side than there are nodes (a map that is one long street)
+    double cells = max<double>(1, n / NODES_PER_CELL);
+    m_cellSize = max(sqrt(width * height / cells), max(width, height) / cells);
+    if (!(m_cellSize > 0)) m_cellSize = 1; // every node in one spot
+    m_columns = (int)(width / m_cellSize) + 1;
+    m_rows = (int)(height / m_cellSize) + 1;
+    size_t cellCount = (size_t)m_columns * m_rows;
+
+    // nodes, counting sorted by cell
+    vector<uint32_t> nodeCell(n);
+    m_nodeStart.assign(cellCount + 1, 0);
+    for (NodeId i = 0; i < n; i++)
+    {
+        nodeCell[i] = row(y(graph.latitude(i))) * m_columns + column(x(graph.longitude(i)));
+        m_nodeStart[nodeCell[i] + 1]++;
+    }
+    for (size_t c = 0; c < cellCount; c++)
+        m_nodeStart[c + 1] += m_nodeStart[c];
+    m_nodes.resize(n);
+    vector<uint32_t> fill(m_nodeStart.begin(), m_nodeStart.end() - 1);
+    for (NodeId i = 0; i < n; i++)
+        m_nodes[fill[nodeCell[i]]++] = i;
+
+    // segments, under every cell their bounding box touches; two passes, one
+    // to count and one to file
+    m_segmentStart.assign(cellCount + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            for (size_t c = 0; c < cellCount; c++)
+                m_segmentStart[c + 1] += m_segmentStart[c];
+            m_segments.resize(m_segmentStart[cellCount]);
+            fill.assign(m_segmentStart.begin(), m_segmentStart.end() - 1);
+        }
+        for (NodeId from = 0; from < n; from++)
+        {
+            int fromCol = nodeCell[from] % m_columns, fromRow = nodeCell[from] / m_columns;
+            for (EdgeId e = graph.edgeBegin(from); e < graph.edgeEnd(from); e++)
+            {
+                NodeId to = graph.edgeTarget(e);
+                int toCol = nodeCell[to] % m_columns, toRow = nodeCell[to] / m_columns;
+                for (int r = min(fromRow, toRow); r <= max(fromRow, toRow); r++)
+                {
+                    for (int c = min(fromCol, toCol); c <= max(fromCol, toCol); c++)
+                    {
+                        size_t cell = (size_t)r * m_columns + c;
+                        if (pass == 0)
+                            m_segmentStart[cell + 1]++;
+                        else
+                        {
+                            Entry entry = { from, e };
+                            m_segments[fill[cell]++] = entry;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+double SpatialIndex::ringBound(double px, double py, int col, int row, int radius) const
+{
+    if (radius == 0) return 0;
+    // the square of radius - 1 has been scanned; everything else lies outside it
+    int left = col - radius + 1, right = col + radius - 1;
+    int bottom = row - radius + 1, top = row + radius - 1;
+    if (left <= 0 && right >= m_columns - 1 && bottom <= 0 && top >= m_rows - 1)
+        return numeric_limits<double>::infinity(); // nothing left
+    double x0 = m_minX + left * m_cellSize, x1 = m_minX + (right + 1) * m_cellSize;
+    double y0 = m_minY + bottom * m_cellSize, y1 = m_minY + (top + 1) * m_cellSize;
+    if (left <= 0) x0 = -numeric_limits<double>::infinity();  // no cells beyond the grid's edges
+    if (right >= m_columns - 1) x1 = numeric_limits<double>::infinity();
+    if (bottom <= 0) y0 = -numeric_limits<double>::infinity();
+    if (top >= m_rows - 1) y1 = numeric_limits<double>::infinity();
+    double bound = min(min(px - x0, x1 - px), min(py - y0, y1 - py));
+    return bound > 0 ? bound : 0;
+}
+
+NodeId SpatialIndex::nearestNode(double latitude, double longitude) const
+{
+    if (empty()) return NO_NODE;
+    double px = x(longitude), py = y(latitude);
+    int col = column(px), row = this->row(py);
+    NodeId best = NO_NODE;
+    double bestSquared = numeric_limits<double>::infinity();
+    for (int radius = 0; ; radius++)
+    {
+        double bound = ringBound(px, py, col, row, radius);
+        if (bound * bound >= bestSquared) break;
+        for (int r = row - radius; r <= row + radius; r++)
+        {
+            if (r < 0 || r >= m_rows) continue;
+            bool edgeRow = r == row - radius || r == row + radius;
+            for (int c = col - radius; c <= col + radius; c += edgeRow ? 1 : 2 * radius)
+            {
+                if (c >= 0 && c < m_columns)
+                {
+                    size_t cell = (size_t)r * m_columns + c;
+                    for (uint32_t i = m_nodeStart[cell]; i < m_nodeStart[cell + 1]; i++)
+                    {
+                        NodeId node = m_nodes[i];
+                        double dx = x(m_graph->longitude(node)) - px;
+                        double dy = y(m_graph->latitude(node)) - py;
+                        double squared = dx * dx + dy * dy;
+                        if (squared < bestSquared || (squared == bestSquared && node < best))
+                        {
+                            bestSquared = squared;
+                            best = node;
+                        }
+                    }
+                }
+                if (radius == 0) break;
+            }
+        }
+    }
+    return best;
+}
+
+bool SpatialIndex::nearestSegment(double latitude, double longitude, SegmentRef& seg, double& miles) const
+{
+    if (empty() || m_segments.empty()) return false;
+    double px = x(longitude), py = y(latitude);
+    int col = column(px), row = this->row(py);
+    const Entry* best = nullptr;
+    double bestSquared = numeric_limits<double>::infinity();
+    for (int radius = 0; ; radius++)
+    {
+        double bound = ringBound(px, py, col, row, radius);
+        if (bound * bound >= bestSquared) break;
+        for (int r = row - radius; r <= row + radius; r++)
+        {
+            if (r < 0 || r >= m_rows) continue;
+            bool edgeRow = r == row - radius || r == row + radius;
+            for (int c = col - radius; c <= col + radius; c += edgeRow ? 1 : 2 * radius)
+            {
+                if (c >= 0 && c < m_columns)
+                {
+                    size_t cell = (size_t)r * m_columns + c;
+                    for (uint32_t i = m_segmentStart[cell]; i < m_segmentStart[cell + 1]; i++)
+                    {
+                        const Entry& entry = m_segments[i];
+                        NodeId to = m_graph->edgeTarget(entry.edge);
+                        double ax = x(m_graph->longitude(entry.from)), ay = y(m_graph->latitude(entry.from));
+                        double bx = x(m_graph->longitude(to)) - ax, by = y(m_graph->latitude(to)) - ay;
+                        double qx = px - ax, qy = py - ay;
+                        double lengthSquared = bx * bx + by * by;
+                        double t = lengthSquared > 0 ? (qx * bx + qy * by) / lengthSquared : 0;
+                        t = t < 0 ? 0 : t > 1 ? 1 : t; // closest point of the segment, not its line
+                        double dx = qx - t * bx, dy = qy - t * by;
+                        double squared = dx * dx + dy * dy;
+                        if (squared < bestSquared || (squared == bestSquared && entry.edge < best->edge))
+                        {
+                            bestSquared = squared;
+                            best = &entry;
+                        }
+                    }
+                }
+                if (radius == 0) break;
+            }
+        }
+    }
+    seg = SegmentRef(m_graph, best->from, best->edge);
+    miles = sqrt(bestSquared);
+    return true;
+}
+
+void SpatialIndex::nearestNodes(const vector<GeoCoord>& points, vector<NodeId>& nodes, unsigned int threads) const
+{
+    nodes.resize(points.size());
+    parallelFor(points.size(), threads, [&](size_t i) {
+        nodes[i] = nearestNode(points[i].latitude, points[i].longitude);
+    });
+}
@@ -0,0 +1,69 @@
+#ifndef SPATIALINDEX_INCLUDED
+#define SPATIALINDEX_INCLUDED
+
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SpatialIndex.h
+
+// A uniform grid over a StreetGraph for snapping arbitrary points, such as raw
+// GPS fixes, onto the map.  Cells are square and sized to hold about two nodes
+// each; every node is filed under the cell containing it, and every segment
+// under each cell its bounding box touches.  A query scans rings of cells
+// outward from the point's cell and stops once the next ring cannot hold
+// anything closer, so it touches a handful of cells on a street map.
+//
+// Distances are measured on a flat projection of the map (longitude scaled by
+// the cosine of its middle latitude), which at city scale agrees with
+// distanceEarthMiles to well under a foot.
+
+class SpatialIndex
+{
+public:
+    SpatialIndex();
+      // index graph, which must outlive the index (or the next build/clear)
+    void build(const StreetGraph& graph);
+    void clear();
+    bool empty() const { return m_graph == nullptr || m_graph->nodeCount() == 0; }
+
+      // node closest to the point, NO_NODE if the index is empty
+    NodeId nearestNode(double latitude, double longitude) const;
+      // segment passing closest to the point, and how far away it is in
+      // miles; false if the map has no segments
+    bool nearestSegment(double latitude, double longitude, SegmentRef& seg, double& miles) const;
+      // nearestNode for every point, on up to threads threads
+    void nearestNodes(const std::vector<GeoCoord>& points, std::vector<NodeId>& nodes, unsigned int threads = 1) const;
+
+    SpatialIndex(const SpatialIndex&) = delete;
+    SpatialIndex& operator=(const SpatialIndex&) = delete;
+private:
+    struct Entry  // one direction of a segment, enough to make a SegmentRef
+    {
+        NodeId from;
+        EdgeId edge;
+    };
+
+    const StreetGraph* m_graph;
+    double   m_lonScale;    // miles per degree of longitude
+    double   m_minX;        // projected corner of the grid, in miles
+    double   m_minY;
+    double   m_cellSize;    // in miles
+    int      m_columns;
+    int      m_rows;
+    std::vector<uint32_t> m_nodeStart;     // [cells + 1] m_nodes of each cell
+    std::vector<NodeId>   m_nodes;
+    std::vector<uint32_t> m_segmentStart;  // [cells + 1] m_segments of each cell
+    std::vector<Entry>    m_segments;
+
+    double x(double longitude) const { return longitude * m_lonScale; }
+    static double y(double latitude);
+    int column(double px) const;
+    int row(double py) const;
+      // no point in a cell outside the square of cells around (col, row) with
+      // this radius is closer than the returned distance
+    double ringBound(double px, double py, int col, int row, int radius) const;
+};
+
+#endif // SPATIALINDEX_INCLUDED
@@ -0,0 +1,491 @@
+#include "StreetGraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+uint32_t hashCoordText(const char* lat, size_t latLength, const char* lon, size_t lonLength)
+{
+    // 32-bit FNV-1a over "lat lon"; std::hash is not guaranteed to be stable,
+    // and this value decides slots in the persisted lookup table
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < latLength; i++)
+        h = (h ^ (unsigned char)lat[i]) * 16777619u;
+    h = (h ^ ' ') * 16777619u;
+    for (size_t i = 0; i < lonLength; i++)
+        h = (h ^ (unsigned char)lon[i]) * 16777619u;
+    return h;
+}
+
+//******************** StreetGraph functions **********************************
+
+StreetGraph::StreetGraph()
+{
+    clear();
+}
+
+void StreetGraph::clear()
+{
+    m_latitudes.clear();
+    m_longitudes.clear();
+    m_coordText.clear();
+    m_edgeOffsets.assign(1, 0);
+    m_edgeTargets.clear();
+    m_edgeLengths.clear();
+    m_edgeNames.clear();
+    m_edgeTwins.clear();
+    m_nameText.clear();
+    m_table.assign(1, NO_NODE);
+    m_text.assign(1, '\0');
+    pointAtStorage();
+}
+
+void StreetGraph::attach(const StreetGraphArrays& arrays)
+{
+    clear();
+    m_a = arrays;
+}
+
+void StreetGraph::pointAtStorage()
+{
+    m_a.nodeCount = (uint32_t)m_latitudes.size();
+    m_a.edgeCount = (uint32_t)m_edgeTargets.size();
+    m_a.nameCount = (uint32_t)m_nameText.size();
+    m_a.tableSize = (uint32_t)m_table.size();
+    m_a.textSize = (uint32_t)m_text.size();
+    m_a.latitudes = m_latitudes.data();
+    m_a.longitudes = m_longitudes.data();
+    m_a.coordText = m_coordText.data();
+    m_a.edgeOffsets = m_edgeOffsets.data();
+    m_a.edgeTargets = m_edgeTargets.data();
+    m_a.edgeLengths = m_edgeLengths.data();
+    m_a.edgeNames = m_edgeNames.data();
+    m_a.edgeTwins = m_edgeTwins.data();
+    m_a.nameText = m_nameText.data();
+    m_a.table = m_table.data();
+    m_a.text = m_text.data();
+}
+
+void StreetGraph::layOutTable(const vector<uint32_t>& hashes)
+{
+    uint32_t tableSize = 16;
+    while (tableSize < 2 * hashes.size())
+        tableSize *= 2;
+    m_table.assign(tableSize, NO_NODE);
+    for (size_t i = 0; i < hashes.size(); i++)
+    {
+        uint32_t slot = hashes[i] & (tableSize - 1);
+        while (m_table[slot] != NO_NODE)
+            slot = (slot + 1) & (tableSize - 1);
+        m_table[slot] = (NodeId)i;
+    }
+}
+
+void StreetGraph::renumber(const vector<NodeId>& order)
+{
+    uint32_t n = m_a.nodeCount;
+    vector<NodeId> newId(n);
+    for (NodeId i = 0; i < n; i++)
+        newId[order[i]] = i;
+
+    vector<double> latitudes(n), longitudes(n), lengths(m_a.edgeCount);
+    vector<uint32_t> coordText(2 * n), hashes(n), names(m_a.edgeCount);
+    vector<EdgeId> offsets(n + 1), twins(m_a.edgeCount), newEdge(m_a.edgeCount);
+    vector<NodeId> targets(m_a.edgeCount);
+    offsets[0] = 0;
+    for (NodeId i = 0; i < n; i++)
+    {
+        NodeId old = order[i];
+        latitudes[i] = m_a.latitudes[old];
+        longitudes[i] = m_a.longitudes[old];
+        coordText[2 * i] = m_a.coordText[2 * old];
+        coordText[2 * i + 1] = m_a.coordText[2 * old + 1];
+        const char* lat = m_a.text + coordText[2 * i];
+        const char* lon = m_a.text + coordText[2 * i + 1];
+        hashes[i] = hashCoordText(lat, strlen(lat), lon, strlen(lon));
+        EdgeId e = offsets[i];
+        for (EdgeId oldEdge = edgeBegin(old); oldEdge < edgeEnd(old); oldEdge++, e++)
+        {
+            targets[e] = newId[m_a.edgeTargets[oldEdge]];
+            lengths[e] = m_a.edgeLengths[oldEdge];
+            names[e] = m_a.edgeNames[oldEdge];
+            newEdge[oldEdge] = e;
+        }
+        offsets[i + 1] = e;
+    }
+    for (EdgeId oldEdge = 0; oldEdge < m_a.edgeCount; oldEdge++)
+    {
+        EdgeId twin = m_a.edgeTwins[oldEdge];
+        twins[newEdge[oldEdge]] = twin == NO_EDGE ? NO_EDGE : newEdge[twin];
+    }
+
+    // names and text are untouched, but an attached graph has to own them now
+    vector<uint32_t> nameText(m_a.nameText, m_a.nameText + m_a.nameCount);
+    string text(m_a.text, m_a.textSize);
+    m_latitudes.swap(latitudes);
+    m_longitudes.swap(longitudes);
+    m_coordText.swap(coordText);
+    m_edgeOffsets.swap(offsets);
+    m_edgeTargets.swap(targets);
+    m_edgeLengths.swap(lengths);
+    m_edgeNames.swap(names);
+    m_edgeTwins.swap(twins);
+    m_nameText.swap(nameText);
+    m_text.swap(text);
+    layOutTable(hashes);
+    pointAtStorage();
+}
+
+void StreetGraph::pairEdges()
+{
+    // Each edge u -> v pairs with an unpaired edge v -> u of the same name,
+    // the closest in length if there are several, so searches that run
+    // against the edges never have to look for the way back themselves.
+    m_edgeTwins.assign(m_edgeTargets.size(), NO_EDGE);
+    for (NodeId from = 0; from + 1 < m_edgeOffsets.size(); from++)
+    {
+        for (EdgeId e = m_edgeOffsets[from]; e < m_edgeOffsets[from + 1]; e++)
+        {
+            if (m_edgeTwins[e] != NO_EDGE) continue;
+            NodeId to = m_edgeTargets[e];
+            EdgeId best = NO_EDGE;
+            for (EdgeId back = m_edgeOffsets[to]; back < m_edgeOffsets[to + 1]; back++)
+            {
+                if (back == e || m_edgeTargets[back] != from || m_edgeNames[back] != m_edgeNames[e] ||
+                    m_edgeTwins[back] != NO_EDGE)
+                    continue;
+                if (best == NO_EDGE || fabs(m_edgeLengths[back] - m_edgeLengths[e]) < fabs(m_edgeLengths[best] - m_edgeLengths[e]))
+                    best = back;
+            }
+            if (best == NO_EDGE) continue;
+            m_edgeTwins[e] = best;
+            m_edgeTwins[best] = e;
+        }
+    }
+}
+
+  // position of cell (x, y) along the Hilbert curve filling a side x side
+  // grid, side a power of two
+static uint64_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y)
+{
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        if (ry == 0) // rotate the quadrant so the curve stays continuous
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            swap(x, y);
+        }
+    }
+    return d;
+}
+
+vector<NodeId> hilbertOrder(const StreetGraph& graph)
+{
+    uint32_t n = graph.nodeCount();
+    vector<NodeId> order(n);
+    if (n == 0) return order;
+    double minLat = graph.latitude(0), maxLat = minLat;
+    double minLon = graph.longitude(0), maxLon = minLon;
+    for (NodeId i = 1; i < n; i++)
+    {
+        minLat = min(minLat, graph.latitude(i));
+        maxLat = max(maxLat, graph.latitude(i));
+        minLon = min(minLon, graph.longitude(i));
+        maxLon = max(maxLon, graph.longitude(i));
+    }
+
+    // 2^16 cells a side is far finer than any two distinct street corners
+    const uint32_t side = 1 << 16;
+    double latScale = maxLat > minLat ? (side - 1) / (maxLat - minLat) : 0;
+    double lonScale = maxLon > minLon ? (side - 1) / (maxLon - minLon) : 0;
+    vector<pair<uint64_t, NodeId>> keyed(n);
+    for (NodeId i = 0; i < n; i++)
+    {
+        uint32_t x = (uint32_t)((graph.longitude(i) - minLon) * lonScale);
+        uint32_t y = (uint32_t)((graph.latitude(i) - minLat) * latScale);
+        keyed[i] = make_pair(hilbertIndex(side, x, y), i);
+    }
+    sort(keyed.begin(), keyed.end()); // ties keep their old order
+    for (NodeId i = 0; i < n; i++)
+        order[i] = keyed[i].second;
+    return order;
+}
+
+size_t StreetGraph::memoryUsage() const
+{
+    size_t nodes = m_a.nodeCount, edges = m_a.edgeCount;
+    return nodes * (2 * sizeof(double) + 2 * sizeof(uint32_t))                  // coordinates, their text offsets
+         + (nodes + 1) * sizeof(EdgeId)                                         // CSR offsets
+         + edges * (sizeof(NodeId) + sizeof(double) + sizeof(uint32_t) + sizeof(EdgeId)) // target, length, name, twin
+         + m_a.nameCount * sizeof(uint32_t) + m_a.tableSize * sizeof(NodeId)
+         + m_a.textSize;
+}
+
+NodeId StreetGraph::findNode(const GeoCoord& gc) const
+{
+    uint32_t mask = m_a.tableSize - 1;
+    uint32_t slot = hashCoordText(gc.latitudeText.data(), gc.latitudeText.size(),
+                                  gc.longitudeText.data(), gc.longitudeText.size()) & mask;
+    for (;;) // linear probing; the table is never full, so this terminates
+    {
+        NodeId n = m_a.table[slot];
+        if (n == NO_NODE) return NO_NODE;
+        if (gc.latitudeText == m_a.text + m_a.coordText[2 * n] &&
+            gc.longitudeText == m_a.text + m_a.coordText[2 * n + 1])
+            return n;
+        slot = (slot + 1) & mask;
+    }
+}
+
+GeoCoord StreetGraph::coord(NodeId n) const
+{
+    GeoCoord gc;
+    gc.latitudeText = m_a.text + m_a.coordText[2 * n];
+    gc.longitudeText = m_a.text + m_a.coordText[2 * n + 1];
+    gc.latitude = m_a.latitudes[n];   // already parsed, no stod needed
+    gc.longitude = m_a.longitudes[n];
+    return gc;
+}
+
+StreetSegment StreetGraph::segment(NodeId from, EdgeId e) const
+{
+    return StreetSegment(coord(from), coord(edgeTarget(e)), name(edgeName(e)));
+}
+
+//******************** StreetGraphBuilder functions ***************************
+
+static uint32_t hashText(const char* s, size_t length)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+StreetGraphBuilder::StreetGraphBuilder()
+{
+    reset();
+}
+
+uint32_t StreetGraphBuilder::appendText(const char* s, size_t length)
+{
+    uint32_t offset = (uint32_t)m_text.size();
+    m_text.append(s, length).push_back('\0');
+    return offset;
+}
+
+void StreetGraphBuilder::growTable(vector<Slot>& table, size_t minimumSize)
+{
+    // hashes are kept in the slots, so growing never rehashes any text
+    size_t size = table.size();
+    while (size < minimumSize)
+        size *= 2;
+    if (size == table.size()) return;
+    vector<Slot> old(size);
+    old.swap(table);
+    Slot empty = { 0, NO_NODE };
+    table.assign(table.size(), empty);
+    uint32_t mask = (uint32_t)table.size() - 1;
+    for (const Slot& entry : old)
+    {
+        if (entry.id == NO_NODE) continue;
+        uint32_t slot = entry.hash & mask;
+        while (table[slot].id != NO_NODE)
+            slot = (slot + 1) & mask;
+        table[slot] = entry;
+    }
+}
+
+NodeId StreetGraphBuilder::addNode(const char* lat, size_t latLength, const char* lon, size_t lonLength,
+                                   double latitude, double longitude)
+{
+    return internNode(hashCoordText(lat, latLength, lon, lonLength), lat, latLength, lon, lonLength, latitude, longitude);
+}
+
+NodeId StreetGraphBuilder::internNode(uint32_t h, const char* lat, size_t latLength, const char* lon, size_t lonLength,
+                                      double latitude, double longitude)
+{
+    uint32_t mask = (uint32_t)m_nodeTable.size() - 1;
+    uint32_t slot = h & mask;
+    for (; m_nodeTable[slot].id != NO_NODE; slot = (slot + 1) & mask)
+    {
+        if (m_nodeTable[slot].hash != h) continue;
+        NodeId n = m_nodeTable[slot].id;
+        const char* latText = m_text.data() + m_coordText[2 * n];
+        const char* lonText = m_text.data() + m_coordText[2 * n + 1];
+        if (strncmp(latText, lat, latLength) == 0 && latText[latLength] == '\0' &&
+            strncmp(lonText, lon, lonLength) == 0 && lonText[lonLength] == '\0')
+            return n;
+    }
+    NodeId n = (NodeId)m_latitudes.size();
+    m_nodeTable[slot].hash = h;
+    m_nodeTable[slot].id = n;
+    m_latitudes.push_back(latitude);
+    m_longitudes.push_back(longitude);
+    m_coordText.push_back(appendText(lat, latLength));
+    m_coordText.push_back(appendText(lon, lonLength));
+    if (2 * m_latitudes.size() > m_nodeTable.size())
+        growTable(m_nodeTable, 2 * m_nodeTable.size());
+    return n;
+}
+
+uint32_t StreetGraphBuilder::addName(const char* name, size_t length)
+{
+    uint32_t h = hashText(name, length);
+    uint32_t mask = (uint32_t)m_nameTable.size() - 1;
+    uint32_t slot = h & mask;
+    for (; m_nameTable[slot].id != NO_NODE; slot = (slot + 1) & mask)
+    {
+        const char* text = m_text.data() + m_nameText[m_nameTable[slot].id];
+        if (m_nameTable[slot].hash == h && strncmp(text, name, length) == 0 && text[length] == '\0')
+            return m_nameTable[slot].id;
+    }
+    uint32_t id = (uint32_t)m_nameText.size();
+    m_nameTable[slot].hash = h;
+    m_nameTable[slot].id = id;
+    m_nameText.push_back(appendText(name, length));
+    if (2 * m_nameText.size() > m_nameTable.size())
+        growTable(m_nameTable, 2 * m_nameTable.size());
+    return id;
+}
+
+void StreetGraphBuilder::addEdge(NodeId from, NodeId to, uint32_t name)
+{
+    addEdge(from, to, name, distanceEarthMiles(m_latitudes[from], m_longitudes[from], m_latitudes[to], m_longitudes[to]));
+}
+
+void StreetGraphBuilder::addEdge(NodeId from, NodeId to, uint32_t name, double length)
+{
+    PendingEdge edge;
+    edge.from = from;
+    edge.to = to;
+    edge.name = name;
+    edge.length = length;
+    m_edges.push_back(edge);
+}
+
+void StreetGraphBuilder::addSegment(const GeoCoord& start, const GeoCoord& end, const string& name)
+{
+    NodeId from = addNode(start.latitudeText.data(), start.latitudeText.size(),
+                          start.longitudeText.data(), start.longitudeText.size(), start.latitude, start.longitude);
+    NodeId to = addNode(end.latitudeText.data(), end.latitudeText.size(),
+                        end.longitudeText.data(), end.longitudeText.size(), end.latitude, end.longitude);
+    addEdge(from, to, addName(name.data(), name.size()));
+}
+
+void StreetGraphBuilder::merge(StreetGraphBuilder& other)
+{
+    // other's slots already hold every node's hash, so no text is rehashed
+    vector<uint32_t> hashes(other.m_latitudes.size());
+    for (const Slot& entry : other.m_nodeTable)
+    {
+        if (entry.id != NO_NODE)
+            hashes[entry.id] = entry.hash;
+    }
+
+    // size everything once instead of growing it along the way
+    growTable(m_nodeTable, 2 * (m_latitudes.size() + hashes.size()) + 1);
+    growTable(m_nameTable, 2 * (m_nameText.size() + other.m_nameText.size()) + 1);
+    m_text.reserve(m_text.size() + other.m_text.size());
+    m_latitudes.reserve(m_latitudes.size() + hashes.size());
+    m_longitudes.reserve(m_longitudes.size() + hashes.size());
+    m_coordText.reserve(m_coordText.size() + 2 * hashes.size());
+    m_nameText.reserve(m_nameText.size() + other.m_nameText.size());
+
+    // Replay names and nodes in the order other first saw them (their text
+    // offsets tell), so the result matches adding other's input here directly.
+    const char* text = other.m_text.data();
+    vector<uint32_t> nameIds(other.m_nameText.size());
+    vector<NodeId> nodeIds(hashes.size());
+    size_t name = 0, node = 0;
+    while (name < nameIds.size() || node < nodeIds.size())
+    {
+        if (node == nodeIds.size() || (name < nameIds.size() && other.m_nameText[name] < other.m_coordText[2 * node]))
+        {
+            const char* s = text + other.m_nameText[name];
+            nameIds[name++] = addName(s, strlen(s));
+        }
+        else
+        {
+            const char* lat = text + other.m_coordText[2 * node];
+            const char* lon = text + other.m_coordText[2 * node + 1];
+            nodeIds[node] = internNode(hashes[node], lat, strlen(lat), lon, strlen(lon),
+                                       other.m_latitudes[node], other.m_longitudes[node]);
+            node++;
+        }
+    }
+
+    m_edges.reserve(m_edges.size() + other.m_edges.size());
+    for (const PendingEdge& pe : other.m_edges)
+        addEdge(nodeIds[pe.from], nodeIds[pe.to], nameIds[pe.name], pe.length);
+    other.reset();
+}
+
+void StreetGraphBuilder::reset()
+{
+    m_text.clear();
+    m_latitudes.clear();
+    m_longitudes.clear();
+    m_coordText.clear();
+    m_nameText.clear();
+    Slot empty = { 0, NO_NODE };
+    m_nodeTable.assign(16, empty);
+    m_nameTable.assign(16, empty);
+    m_edges.clear();
+}
+
+void StreetGraphBuilder::build(StreetGraph& graph)
+{
+    graph.clear();
+    size_t nodeCount = m_latitudes.size();
+
+    // coordinates, names and the lookup table are already in their final form
+    if (m_text.empty()) m_text.push_back('\0');
+    graph.m_text.swap(m_text);
+    graph.m_latitudes.swap(m_latitudes);
+    graph.m_longitudes.swap(m_longitudes);
+    graph.m_coordText.swap(m_coordText);
+    graph.m_nameText.swap(m_nameText);
+
+    // Lay the lookup table out afresh in node order.  The builder's table
+    // depends on how it grew, and two builders fed the same input (one of
+    // them by merge) must still produce byte-identical graphs.
+    vector<uint32_t> hashes(nodeCount);
+    for (const Slot& entry : m_nodeTable)
+    {
+        if (entry.id != NO_NODE)
+            hashes[entry.id] = entry.hash;
+    }
+    graph.layOutTable(hashes);
+
+    // counting sort of the edges by source node; stable, so file order survives
+    graph.m_edgeOffsets.assign(nodeCount + 1, 0);
+    for (size_t i = 0; i < m_edges.size(); i++)
+        graph.m_edgeOffsets[m_edges[i].from + 1]++;
+    for (size_t i = 0; i < nodeCount; i++)
+        graph.m_edgeOffsets[i + 1] += graph.m_edgeOffsets[i];
+    vector<EdgeId> next(graph.m_edgeOffsets.begin(), graph.m_edgeOffsets.end() - 1);
+    graph.m_edgeTargets.resize(m_edges.size());
+    graph.m_edgeLengths.resize(m_edges.size());
+    graph.m_edgeNames.resize(m_edges.size());
+    for (size_t i = 0; i < m_edges.size(); i++)
+    {
+        const PendingEdge& pe = m_edges[i];
+        EdgeId e = next[pe.from]++;
+        graph.m_edgeTargets[e] = pe.to;
+        graph.m_edgeLengths[e] = pe.length;
+        graph.m_edgeNames[e] = pe.name;
+    }
+    graph.pairEdges();
+    graph.pointAtStorage();
+
+    reset(); // leave the builder empty and reusable
+}
@@ -0,0 +1,259 @@
+#ifndef STREETGRAPH_INCLUDED
+#define STREETGRAPH_INCLUDED
+
+#include "provided.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// StreetGraph.h
+
+// The street map as a compressed-sparse-row graph.  Every distinct coordinate
+// is interned to a dense NodeId, and the segments leaving node n are the edges
+// [edgeBegin(n), edgeEnd(n)), stored as parallel arrays of target node, length
+// in miles, street name id and the twin edge going back the other way.  The arrays are either owned by the graph (when
+// built from mapdata.txt) or borrowed from a mapped snapshot.
+
+typedef uint32_t NodeId;
+typedef uint32_t EdgeId;
+const uint32_t NO_NODE = 0xFFFFFFFF;
+const uint32_t NO_EDGE = 0xFFFFFFFF;
+
+class SegmentRange;
+
+  // hash of a coordinate's text, stable across runs and platforms
+uint32_t hashCoordText(const char* lat, size_t latLength, const char* lon, size_t lonLength);
+
+  // raw views of every array making up a graph; MapSnapshot.h stores exactly these
+struct StreetGraphArrays
+{
+    uint32_t        nodeCount;
+    uint32_t        edgeCount;
+    uint32_t        nameCount;
+    uint32_t        tableSize;    // power of two
+    uint32_t        textSize;
+    const double*   latitudes;    // [nodeCount]
+    const double*   longitudes;   // [nodeCount]
+    const uint32_t* coordText;    // [2 * nodeCount] text offsets of latitude, longitude
+    const EdgeId*   edgeOffsets;  // [nodeCount + 1]
+    const NodeId*   edgeTargets;  // [edgeCount]
+    const double*   edgeLengths;  // [edgeCount] in miles
+    const uint32_t* edgeNames;    // [edgeCount]
+    const EdgeId*   edgeTwins;    // [edgeCount] the edge back along each, or NO_EDGE
+    const uint32_t* nameText;     // [nameCount] text offset of each street name
+    const NodeId*   table;        // [tableSize] open-addressed coordinate -> node lookup
+    const char*     text;         // [textSize] NUL-terminated strings
+};
+
+class StreetGraph
+{
+public:
+    StreetGraph();
+    void clear();
+    bool empty() const { return m_a.nodeCount == 0; }
+
+      // point the graph at arrays it does not own (they must outlive it)
+    void attach(const StreetGraphArrays& arrays);
+      // Renumber the nodes so that node i is the old node order[i].  Edges
+      // move with their source node and keep their order.  An attached graph
+      // is copied into owned storage first.
+    void renumber(const std::vector<NodeId>& order);
+    const StreetGraphArrays& arrays() const { return m_a; }
+
+    uint32_t nodeCount() const { return m_a.nodeCount; }
+    uint32_t edgeCount() const { return m_a.edgeCount; }
+    uint32_t nameCount() const { return m_a.nameCount; }
+      // bytes taken by the arrays, whether owned or mapped
+    size_t memoryUsage() const;
+    NodeId findNode(const GeoCoord& gc) const;
+    GeoCoord coord(NodeId n) const;
+    double latitude(NodeId n) const { return m_a.latitudes[n]; }
+    double longitude(NodeId n) const { return m_a.longitudes[n]; }
+
+      // neighbors of n are edgeTarget(e) for e in [edgeBegin(n), edgeEnd(n))
+    EdgeId edgeBegin(NodeId n) const { return m_a.edgeOffsets[n]; }
+    EdgeId edgeEnd(NodeId n) const { return m_a.edgeOffsets[n + 1]; }
+    NodeId edgeTarget(EdgeId e) const { return m_a.edgeTargets[e]; }
+    double edgeLength(EdgeId e) const { return m_a.edgeLengths[e]; }
+    uint32_t edgeName(EdgeId e) const { return m_a.edgeNames[e]; }
+    const char* name(uint32_t nameId) const { return m_a.text + m_a.nameText[nameId]; }
+
+      // the edge back along e: from e's target to e's source, of the same
+      // name; NO_EDGE if the map has none
+    EdgeId reverseEdge(EdgeId e) const { return m_a.edgeTwins[e]; }
+      // materialize edge e (leaving node from) as a StreetSegment
+    StreetSegment segment(NodeId from, EdgeId e) const;
+      // the segments leaving n, viewed in place without copying
+    SegmentRange segmentsFrom(NodeId n) const;
+
+    StreetGraph(const StreetGraph&) = delete;
+    StreetGraph& operator=(const StreetGraph&) = delete;
+private:
+    friend class StreetGraphBuilder;
+
+    StreetGraphArrays m_a;
+
+      // storage behind m_a when the graph was built rather than attached
+    std::vector<double>   m_latitudes;
+    std::vector<double>   m_longitudes;
+    std::vector<uint32_t> m_coordText;
+    std::vector<EdgeId>   m_edgeOffsets;
+    std::vector<NodeId>   m_edgeTargets;
+    std::vector<double>   m_edgeLengths;
+    std::vector<uint32_t> m_edgeNames;
+    std::vector<EdgeId>   m_edgeTwins;
+    std::vector<uint32_t> m_nameText;
+    std::vector<NodeId>   m_table;
+    std::string           m_text;
+
+    void pointAtStorage();
+      // fill m_edgeTwins from the owned edge arrays
+    void pairEdges();
+      // lay out m_table afresh, inserting the nodes (with these hashes) in id order
+    void layOutTable(const std::vector<uint32_t>& hashes);
+};
+
+  // The nodes of graph sorted along a Hilbert curve over their coordinates,
+  // ready for renumber: nodes that are close on the map get close ids, and so
+  // close places in every per-node array.
+std::vector<NodeId> hilbertOrder(const StreetGraph& graph);
+
+  // A stored segment viewed in place: no strings are copied and nothing is
+  // allocated.  Valid for as long as the graph it came from.
+class SegmentRef
+{
+public:
+    SegmentRef() : m_graph(nullptr), m_from(NO_NODE), m_edge(0) {}
+    SegmentRef(const StreetGraph* graph, NodeId from, EdgeId e) : m_graph(graph), m_from(from), m_edge(e) {}
+    NodeId startNode() const { return m_from; }
+    NodeId endNode() const { return m_graph->edgeTarget(m_edge); }
+    EdgeId edge() const { return m_edge; }
+    double length() const { return m_graph->edgeLength(m_edge); }
+    uint32_t nameId() const { return m_graph->edgeName(m_edge); }  // equal ids <=> equal names
+    const char* name() const { return m_graph->name(nameId()); }
+    double startLatitude() const { return m_graph->latitude(m_from); }
+    double startLongitude() const { return m_graph->longitude(m_from); }
+    double endLatitude() const { return m_graph->latitude(endNode()); }
+    double endLongitude() const { return m_graph->longitude(endNode()); }
+    StreetSegment toStreetSegment() const { return m_graph->segment(m_from, m_edge); }
+private:
+    const StreetGraph* m_graph;
+    NodeId m_from;
+    EdgeId m_edge;
+};
+
+  // the segments leaving one node; usable in a range-based for loop
+class SegmentRange
+{
+public:
+    class iterator
+    {
+    public:
+        iterator(const StreetGraph* graph, NodeId from, EdgeId e) : m_graph(graph), m_from(from), m_edge(e) {}
+        SegmentRef operator*() const { return SegmentRef(m_graph, m_from, m_edge); }
+        iterator& operator++() { m_edge++; return *this; }
+        bool operator==(const iterator& other) const { return m_edge == other.m_edge; }
+        bool operator!=(const iterator& other) const { return m_edge != other.m_edge; }
+    private:
+        const StreetGraph* m_graph;
+        NodeId m_from;
+        EdgeId m_edge;
+    };
+
+    SegmentRange() : m_graph(nullptr), m_from(NO_NODE), m_first(0), m_last(0) {}
+    SegmentRange(const StreetGraph* graph, NodeId from, EdgeId first, EdgeId last)
+     : m_graph(graph), m_from(from), m_first(first), m_last(last) {}
+    iterator begin() const { return iterator(m_graph, m_from, m_first); }
+    iterator end() const { return iterator(m_graph, m_from, m_last); }
+    bool empty() const { return m_first == m_last; }
+    size_t size() const { return m_last - m_first; }
+    SegmentRef operator[](size_t i) const { return SegmentRef(m_graph, m_from, m_first + (EdgeId)i); }
+private:
+    const StreetGraph* m_graph;
+    NodeId m_from;
+    EdgeId m_first;
+    EdgeId m_last;
+};
+
+inline SegmentRange StreetGraph::segmentsFrom(NodeId n) const
+{
+    return SegmentRange(this, n, edgeBegin(n), edgeEnd(n));
+}
+
+  // SegmentRef versions of the helpers in provided.h
+inline double angleOfLine(const SegmentRef& line)
+{
+    double angle = atan2(line.endLatitude() - line.startLatitude(), line.endLongitude() - line.startLongitude());
+    double result = rad2deg(angle);
+    if (result < 0)
+        result += 360;
+
+    return result;
+}
+
+inline double angleBetween2Lines(const SegmentRef& line1, const SegmentRef& line2)
+{
+    double angle1 = atan2(line1.endLatitude() - line1.startLatitude(), line1.endLongitude() - line1.startLongitude());
+    double angle2 = atan2(line2.endLatitude() - line2.startLatitude(), line2.endLongitude() - line2.startLongitude());
+
+    double result = rad2deg(angle2 - angle1);
+    if (result < 0)
+        result += 360;
+
+    return result;
+}
+
+  // Collects segments in file order and turns them into a StreetGraph.  The
+  // edges of each node keep the order in which they were added.  Coordinates
+  // and names are interned straight into the graph's text section, so adding
+  // text that was seen before allocates nothing.
+class StreetGraphBuilder
+{
+public:
+    StreetGraphBuilder();
+    NodeId addNode(const char* lat, size_t latLength, const char* lon, size_t lonLength,
+                   double latitude, double longitude);
+    uint32_t addName(const char* name, size_t length);
+    void addEdge(NodeId from, NodeId to, uint32_t name);
+    void addEdge(NodeId from, NodeId to, uint32_t name, double length);
+    void addSegment(const GeoCoord& start, const GeoCoord& end, const std::string& name);
+      // add everything other collected, in other's order, as if it had been
+      // added here directly; other is left empty
+    void merge(StreetGraphBuilder& other);
+    uint32_t nodeCount() const { return (uint32_t)m_latitudes.size(); }
+    uint32_t edgeCount() const { return (uint32_t)m_edges.size(); }
+      // moves everything into graph; the builder is empty afterwards
+    void build(StreetGraph& graph);
+    StreetGraphBuilder(const StreetGraphBuilder&) = delete;
+    StreetGraphBuilder& operator=(const StreetGraphBuilder&) = delete;
+private:
+    struct PendingEdge
+    {
+        NodeId   from;
+        NodeId   to;
+        uint32_t name;
+        double   length;
+    };
+    struct Slot  // hash kept beside the id so most mismatches never touch the text
+    {
+        uint32_t hash;
+        uint32_t id;
+    };
+    std::string           m_text;
+    std::vector<double>   m_latitudes;
+    std::vector<double>   m_longitudes;
+    std::vector<uint32_t> m_coordText;
+    std::vector<Slot>     m_nodeTable;   // open addressed, at most half full
+    std::vector<uint32_t> m_nameText;
+    std::vector<Slot>     m_nameTable;
+    std::vector<PendingEdge> m_edges;
+
+    NodeId internNode(uint32_t hash, const char* lat, size_t latLength, const char* lon, size_t lonLength,
+                      double latitude, double longitude);
+    uint32_t appendText(const char* s, size_t length);
+    void reset();
+    static void growTable(std::vector<Slot>& table, size_t minimumSize);
+};
+
+#endif // STREETGRAPH_INCLUDED
@@ -1,14 +1,28 @@
 #include "provided.h"
+#include "CellOverlay.h"
+#include "ChainGraph.h"
+#include "ContractionHierarchy.h"
 #include "ExpandableHashMap.h"
+#include "LandmarkTable.h"
+#include "MapParser.h"
+#include "MapSnapshot.h"
+#include "Parallel.h"
+#include "SpatialIndex.h"
+#include "StreetGraph.h"
+#include <atomic>
 #include <string>
 #include <vector>
 #include <functional>
-#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
 using namespace std;
 
+const long PARALLEL_LOAD_BYTES = 16 << 20; // smaller maps load faster on one thread
+
 unsigned int hasher(const GeoCoord& g)
 {
-    return std::hash<string>()(g.latitudeText + g.longitudeText);
+    // both texts streamed through one hash state: no temporary string
+    return hashCoordText(g.latitudeText.data(), g.latitudeText.size(), g.longitudeText.data(), g.longitudeText.size());
 }
 
 unsigned int hasher(const string& s)
@@ -21,13 +35,39 @@ class StreetMapImpl
 public:
     StreetMapImpl();
     ~StreetMapImpl();
-    bool load(string mapFile);
+    bool load(string mapFile, unsigned int loaderThreads);
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    SegmentRange segmentsThatStartWith(const GeoCoord& gc) const;
+    const StreetGraph& graph() const;
+    unsigned long generation() const;
+    bool nearestCoord(const GeoCoord& gc, GeoCoord& nearest) const;
+    bool nearestSegment(const GeoCoord& gc, StreetSegment& seg) const;
+    int snapToMap(vector<DeliveryRequest>& deliveries) const;
+    const SpatialIndex& spatialIndex() const;
+    void contractChains();
+    const ChainGraph* chainGraph() const;
+    void buildHierarchy();
+    bool loadHierarchy(const string& file);
+    bool saveHierarchy(const string& file) const;
+    const ContractionHierarchy* hierarchy() const;
+    void selectLandmarks(int count, LandmarkSelection how);
+    const LandmarkTable* landmarks() const;
+    void buildOverlay(ThreadPool* pool);
+    bool applyTraffic(const string& file, ThreadPool* pool);
+    const CellOverlay* overlay() const;
 private:
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> m_coordMap;
+    MapSnapshot m_snapshot; // backs m_graph when loaded from a snapshot
+    atomic<unsigned long> m_generation; // bumped whenever m_graph is replaced or re-weighted
+    StreetGraph m_graph;
+    SpatialIndex m_index;
+    ChainGraph m_chains;    // empty unless contractChains was called
+    ContractionHierarchy m_hierarchy; // empty unless built or loaded
+    LandmarkTable m_landmarks;        // empty unless selectLandmarks was called
+    CellOverlay m_overlay;            // empty unless buildOverlay or applyTraffic was called
 };
 
-StreetMapImpl::StreetMapImpl() // nothing to do here
+StreetMapImpl::StreetMapImpl()
+ : m_generation(0)
 {
 }
 
@@ -35,59 +75,197 @@ StreetMapImpl::~StreetMapImpl() // nothing to do here
 {
 }
 
-bool StreetMapImpl::load(string mapFile)
+bool StreetMapImpl::load(string mapFile, unsigned int loaderThreads)
 {
-    ifstream data(mapFile);
-    if (!data) return false;
-    
-    string s;
-    for (;;) // this loops for the amount of street names
+    if (MapSnapshot::isSnapshotFile(mapFile))
     {
-        string name, amount, startLat, startLong, endLat, endLong;
-        if (!getline(data, name) || !getline(data, amount)) break;
-        for (int i = 0; i < stoi(amount); i++) // this loops an for the amount of segments contained by a street name
-        {
-            // associate the actual coord
-            if (!getline(data, startLat, ' ') || !getline(data, startLong, ' ') || !getline(data, endLat, ' ') || !getline(data, endLong)) return false;
-            GeoCoord startCoord(startLat, startLong);
-            GeoCoord endCoord(endLat, endLong);
-            StreetSegment seg(startCoord, endCoord, name);
-            vector<StreetSegment>* findCoord = m_coordMap.find(startCoord);
-            if (findCoord != nullptr)
-                findCoord->push_back(seg);
-            else
-            {
-                vector<StreetSegment> segVec;
-                segVec.push_back(seg);
-                m_coordMap.associate(startCoord, segVec);
-            }
-            
-            // associate the reverse
-            StreetSegment reverseSeg(endCoord, startCoord, name);
-            vector<StreetSegment>* findCoord2 = m_coordMap.find(endCoord);
-            if (findCoord2 != nullptr)
-                findCoord2->push_back(reverseSeg);
-            else
-            {
-                vector<StreetSegment> revSegVec;
-                revSegVec.push_back(reverseSeg);
-                m_coordMap.associate(endCoord, revSegVec);
-            }
-        }
+        // opened aside first, so a damaged snapshot leaves the old map in place
+        MapSnapshot snapshot;
+        if (!snapshot.open(mapFile)) return false;
+        m_overlay.clear();
+        m_landmarks.clear();
+        m_hierarchy.clear();
+        m_chains.clear();
+        m_index.clear();
+        m_graph.clear();
+        m_generation++;
+        m_snapshot.swap(snapshot); // the old mapping, if any, is closed with snapshot
+        m_graph.attach(m_snapshot.arrays()); // no parsing, the graph lives in the mapped file
+        m_index.build(m_graph);
+        return true;
     }
-    // m_coordMap.print();
+
+    if (loaderThreads == 0)
+    {
+        // threads only pay for themselves once the file is big
+        struct stat st;
+        bool big = stat(mapFile.c_str(), &st) == 0 && st.st_size >= PARALLEL_LOAD_BYTES;
+        loaderThreads = big ? defaultThreadCount() : 1;
+    }
+    StreetGraphBuilder builder;
+    MapParser parser;
+    if (!parser.parse(mapFile, builder, loaderThreads))
+    {
+        cerr << parser.error() << endl;
+        return false;
+    }
+    m_overlay.clear();
+    m_landmarks.clear();
+    m_hierarchy.clear();
+    m_chains.clear();
+    m_index.clear();
+    m_graph.clear();
+    m_generation++;
+    m_snapshot.close();
+    builder.build(m_graph);
+    m_graph.renumber(hilbertOrder(m_graph)); // neighbors on the map become neighbors in memory
+    m_index.build(m_graph);
     return true;
 }
 
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    if (!m_coordMap.find(gc)) return false;
+    NodeId node = m_graph.findNode(gc);
+    if (node == NO_NODE) return false;
     segs.clear();
-    const vector<StreetSegment> temp = (*m_coordMap.find(gc));
-    segs = temp;
+    for (SegmentRef seg : m_graph.segmentsFrom(node))
+        segs.push_back(seg.toStreetSegment());
     return true;
 }
 
+SegmentRange StreetMapImpl::segmentsThatStartWith(const GeoCoord& gc) const
+{
+    NodeId node = m_graph.findNode(gc);
+    if (node == NO_NODE) return SegmentRange();
+    return m_graph.segmentsFrom(node);
+}
+
+const StreetGraph& StreetMapImpl::graph() const
+{
+    return m_graph;
+}
+
+unsigned long StreetMapImpl::generation() const
+{
+    return m_generation;
+}
+
+bool StreetMapImpl::nearestCoord(const GeoCoord& gc, GeoCoord& nearest) const
+{
+    NodeId node = m_graph.findNode(gc);
+    if (node == NO_NODE) node = m_index.nearestNode(gc.latitude, gc.longitude);
+    if (node == NO_NODE) return false;
+    nearest = m_graph.coord(node);
+    return true;
+}
+
+bool StreetMapImpl::nearestSegment(const GeoCoord& gc, StreetSegment& seg) const
+{
+    SegmentRef ref;
+    double miles;
+    if (!m_index.nearestSegment(gc.latitude, gc.longitude, ref, miles)) return false;
+    seg = ref.toStreetSegment();
+    return true;
+}
+
+int StreetMapImpl::snapToMap(vector<DeliveryRequest>& deliveries) const
+{
+    if (m_index.empty()) return 0;
+    vector<GeoCoord> offMap;
+    vector<size_t> which;
+    for (size_t i = 0; i < deliveries.size(); i++)
+    {
+        if (m_graph.findNode(deliveries[i].location) == NO_NODE)
+        {
+            offMap.push_back(deliveries[i].location);
+            which.push_back(i);
+        }
+    }
+    vector<NodeId> nodes;
+    m_index.nearestNodes(offMap, nodes);
+    for (size_t i = 0; i < which.size(); i++)
+        deliveries[which[i]].location = m_graph.coord(nodes[i]);
+    return (int)which.size();
+}
+
+const SpatialIndex& StreetMapImpl::spatialIndex() const
+{
+    return m_index;
+}
+
+void StreetMapImpl::contractChains()
+{
+    m_chains.build(m_graph);
+}
+
+const ChainGraph* StreetMapImpl::chainGraph() const
+{
+    return m_chains.empty() ? nullptr : &m_chains;
+}
+
+void StreetMapImpl::buildHierarchy()
+{
+    m_hierarchy.build(m_graph);
+}
+
+bool StreetMapImpl::loadHierarchy(const string& file)
+{
+    return m_hierarchy.load(file, m_graph);
+}
+
+bool StreetMapImpl::saveHierarchy(const string& file) const
+{
+    return m_hierarchy.save(file);
+}
+
+const ContractionHierarchy* StreetMapImpl::hierarchy() const
+{
+    return m_hierarchy.empty() ? nullptr : &m_hierarchy;
+}
+
+void StreetMapImpl::selectLandmarks(int count, LandmarkSelection how)
+{
+    m_landmarks.build(m_graph, count, how);
+}
+
+const LandmarkTable* StreetMapImpl::landmarks() const
+{
+    return m_landmarks.empty() ? nullptr : &m_landmarks;
+}
+
+void StreetMapImpl::buildOverlay(ThreadPool* pool)
+{
+    m_overlay.build(m_graph, pool);
+    m_generation++; // routes cached under other traffic are stale
+}
+
+bool StreetMapImpl::applyTraffic(const string& file, ThreadPool* pool)
+{
+    if (m_overlay.empty())
+        m_overlay.build(m_graph, pool);
+    vector<double> weights;
+    string error;
+    if (!m_overlay.readTraffic(file, weights, error))
+    {
+        cerr << error << endl;
+        return false;
+    }
+    m_overlay.customize(weights, pool);
+    m_generation++;
+    return true;
+}
+
+const CellOverlay* StreetMapImpl::overlay() const
+{
+    return m_overlay.empty() ? nullptr : &m_overlay;
+}
+
+bool compileMapSnapshot(const string& mapFile, const string& snapshotFile)
+{
+    StreetMapImpl impl;
+    return impl.load(mapFile, 0) && writeMapSnapshot(impl.graph(), snapshotFile);
+}
+
 //******************** StreetMap functions ************************************
 
 // These functions simply delegate to StreetMapImpl's functions.
@@ -105,10 +283,105 @@ StreetMap::~StreetMap()
 
 bool StreetMap::load(string mapFile)
 {
-    return m_impl->load(mapFile);
+    return m_impl->load(mapFile, 0);
+}
+
+bool StreetMap::load(string mapFile, unsigned int loaderThreads)
+{
+    return m_impl->load(mapFile, loaderThreads);
 }
 
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
+
+SegmentRange StreetMap::segmentsThatStartWith(const GeoCoord& gc) const
+{
+    return m_impl->segmentsThatStartWith(gc);
+}
+
+const StreetGraph& StreetMap::graph() const
+{
+    return m_impl->graph();
+}
+
+unsigned long StreetMap::generation() const
+{
+    return m_impl->generation();
+}
+
+bool StreetMap::nearestCoord(const GeoCoord& gc, GeoCoord& nearest) const
+{
+    return m_impl->nearestCoord(gc, nearest);
+}
+
+bool StreetMap::nearestSegment(const GeoCoord& gc, StreetSegment& seg) const
+{
+    return m_impl->nearestSegment(gc, seg);
+}
+
+int StreetMap::snapToMap(vector<DeliveryRequest>& deliveries) const
+{
+    return m_impl->snapToMap(deliveries);
+}
+
+const SpatialIndex& StreetMap::spatialIndex() const
+{
+    return m_impl->spatialIndex();
+}
+
+void StreetMap::contractChains()
+{
+    m_impl->contractChains();
+}
+
+const ChainGraph* StreetMap::chainGraph() const
+{
+    return m_impl->chainGraph();
+}
+
+void StreetMap::buildHierarchy()
+{
+    m_impl->buildHierarchy();
+}
+
+bool StreetMap::loadHierarchy(const string& file)
+{
+    return m_impl->loadHierarchy(file);
+}
+
+bool StreetMap::saveHierarchy(const string& file) const
+{
+    return m_impl->saveHierarchy(file);
+}
+
+const ContractionHierarchy* StreetMap::hierarchy() const
+{
+    return m_impl->hierarchy();
+}
+
+void StreetMap::selectLandmarks(int count, LandmarkSelection how)
+{
+    m_impl->selectLandmarks(count, how);
+}
+
+const LandmarkTable* StreetMap::landmarks() const
+{
+    return m_impl->landmarks();
+}
+
+void StreetMap::buildOverlay(ThreadPool* pool)
+{
+    m_impl->buildOverlay(pool);
+}
+
+bool StreetMap::applyTraffic(const string& file, ThreadPool* pool)
+{
+    return m_impl->applyTraffic(file, pool);
+}
+
+const CellOverlay* StreetMap::overlay() const
+{
+    return m_impl->overlay();
+}
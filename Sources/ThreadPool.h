@@ -0,0 +1,188 @@
+#ifndef THREADPOOL_INCLUDED
+#define THREADPOOL_INCLUDED
+
+#include "Parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ThreadPool.h
+
+// A pool of threads that stay up between jobs, for work that comes in many
+// small batches (the legs of one delivery plan, the rows of one distance
+// matrix), where starting threads for each batch would cost more than the
+// batch.  A job is a parallel for loop: its indices are dealt out in
+// contiguous blocks, one deque per thread, and each thread works from the
+// back of its own deque and, when that runs dry, steals from the front of
+// the others', so a few long tasks (one leg across the whole map) do not
+// hold up the rest.  The calling thread works too.
+//
+// The task is told which thread runs it (0 is the caller), so it can keep
+// state per thread, such as a router; every index still runs exactly once.
+// One job runs at a time per pool; concurrent callers take turns.  A task
+// that throws does not stop the others: parallelFor rethrows the first
+// exception on the caller once every index has run.
+
+class ThreadPool
+{
+public:
+      // threads counts the caller, so 1 runs everything on the calling thread
+    explicit ThreadPool(unsigned int threads = defaultThreadCount())
+     : m_queues(threads > 0 ? threads : 1), m_job(nullptr), m_round(0), m_pending(0), m_stop(false)
+    {
+        for (unsigned int t = 1; t < m_queues.size(); t++)
+            m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, t));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> hold(m_lock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& t : m_workers)
+            t.join();
+    }
+
+    unsigned int threadCount() const { return (unsigned int)m_queues.size(); }
+
+      // Run task(i, thread) for every i in [0, count), thread being which of
+      // the pool's threadCount() threads runs it.  Returns when all are done.
+    template<typename Task>
+    void parallelFor(size_t count, const Task& task)
+    {
+        if (count == 0) return;
+        if (m_queues.size() == 1 || count == 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                task(i, 0u);
+            return;
+        }
+        std::lock_guard<std::mutex> turn(m_runLock);
+        std::function<void(size_t, unsigned int)> job = [&task](size_t i, unsigned int thread) { task(i, thread); };
+        // the job must be in place before any index is: a worker still
+        // finishing the last round may pick the first ones up
+        m_job = &job;
+        m_pending = count;
+        size_t queues = m_queues.size();
+        for (size_t q = 0; q < queues; q++)
+        {
+            std::lock_guard<std::mutex> hold(m_queues[q].lock);
+            for (size_t i = count * q / queues; i < count * (q + 1) / queues; i++)
+                m_queues[q].items.push_back(i);
+        }
+        {
+            std::lock_guard<std::mutex> hold(m_lock);
+            m_round++;
+        }
+        m_wake.notify_all();
+        work(0);
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> hold(m_lock);
+            m_done.wait(hold, [this] { return m_pending == 0; });
+            m_job = nullptr;
+            error = m_error;
+            m_error = nullptr;
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> items;
+    };
+
+    std::vector<Queue> m_queues;  // one per thread, the caller's first
+    std::vector<std::thread> m_workers;
+    std::atomic<const std::function<void(size_t, unsigned int)>*> m_job;
+    std::mutex m_runLock;         // held by the caller for a whole job
+    std::mutex m_lock;            // guards m_round, m_stop and m_error, and the waits
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    uint64_t m_round;             // bumped for each job, to wake the workers
+    std::atomic<size_t> m_pending;
+    bool m_stop;
+    std::exception_ptr m_error;   // the first a task of this job threw
+
+      // the next index for thread self: its own newest, else another's oldest
+    bool take(size_t self, size_t& index)
+    {
+        {
+            Queue& own = m_queues[self];
+            std::lock_guard<std::mutex> hold(own.lock);
+            if (!own.items.empty())
+            {
+                index = own.items.back();
+                own.items.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < m_queues.size(); k++)
+        {
+            Queue& victim = m_queues[(self + k) % m_queues.size()];
+            std::lock_guard<std::mutex> hold(victim.lock);
+            if (!victim.items.empty())
+            {
+                index = victim.items.front();
+                victim.items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        size_t index;
+        while (take(self, index))
+        {
+            try
+            {
+                (*m_job)(index, (unsigned int)self);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> hold(m_lock);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+            if (--m_pending == 0)
+            {
+                std::lock_guard<std::mutex> hold(m_lock);
+                m_done.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(size_t self)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> hold(m_lock);
+                m_wake.wait(hold, [&] { return m_stop || m_round != seen; });
+                if (m_stop) return;
+                seen = m_round;
+            }
+            work(self);
+        }
+    }
+};
+
+#endif // THREADPOOL_INCLUDED
@@ -1,13 +1,15 @@
 #ifndef PROVIDED_INCLUDED
 #define PROVIDED_INCLUDED
 
-// YOU MUST MAKE NO CHANGES TO THIS FILE!
+// Public interface of the delivery service.  Implementations live in the
+// *Impl classes of the matching .cpp files.
 
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <list>
+#include <utility>
 
 enum DeliveryResult
 {
@@ -71,7 +73,25 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
     return lhs.start == rhs.start  &&  lhs.end == rhs.end;
 }
 
+struct DeliveryRequest;
 class StreetMapImpl;
+class StreetGraph;
+class SegmentRef;
+class SegmentRange;
+class SpatialIndex;
+class ChainGraph;
+class ContractionHierarchy;
+class LandmarkTable;
+class CellOverlay;
+class RouteCache;
+class ThreadPool;
+class SearchWorkspace;
+
+  // how StreetMap::selectLandmarks spreads its landmarks (see LandmarkTable.h)
+enum LandmarkSelection
+{
+    LANDMARKS_FARTHEST, LANDMARKS_AVOID
+};
 
 class StreetMap
 {
@@ -79,7 +99,64 @@ public:
     StreetMap();
     ~StreetMap();
     bool load(std::string mapFile);
+      // parse mapdata.txt on loaderThreads threads (0 = pick by file size)
+    bool load(std::string mapFile, unsigned int loaderThreads);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // the same segments viewed in place, valid for the lifetime of the map
+      // (empty if gc is not on the map)
+    SegmentRange segmentsThatStartWith(const GeoCoord& gc) const;
+      // dense node id / CSR view of the loaded map (see StreetGraph.h)
+    const StreetGraph& graph() const;
+      // changes every time the map is loaded again or its traffic changes:
+      // anything cached from it is stale once this differs from when it was cached
+    unsigned long generation() const;
+      // the map coordinate closest to gc (gc itself if it is on the map);
+      // false if the map is empty
+    bool nearestCoord(const GeoCoord& gc, GeoCoord& nearest) const;
+      // the segment passing closest to gc; false if the map is empty
+    bool nearestSegment(const GeoCoord& gc, StreetSegment& seg) const;
+      // move every delivery location that is not on the map to the closest
+      // map coordinate, so raw GPS points can be planned; returns how many moved
+    int snapToMap(std::vector<DeliveryRequest>& deliveries) const;
+      // grid index over the map's nodes and segments (see SpatialIndex.h)
+    const SpatialIndex& spatialIndex() const;
+      // Optional preprocessing: collapse runs of nodes that have exactly two
+      // neighbors into single edges (see ChainGraph.h).  Routers over this map
+      // then search the smaller graph.  Undone by the next load.
+    void contractChains();
+      // the contracted graph, nullptr unless contractChains was called
+    const ChainGraph* chainGraph() const;
+      // Optional preprocessing: a contraction hierarchy over the map (see
+      // ContractionHierarchy.h), built here or loaded from a file saved for
+      // this same map.  Routers over this map then answer every query from
+      // it, whatever their search mode.  Undone by the next load.
+    void buildHierarchy();
+    bool loadHierarchy(const std::string& file);
+    bool saveHierarchy(const std::string& file) const;
+      // nullptr unless a hierarchy was built or loaded
+    const ContractionHierarchy* hierarchy() const;
+      // Optional preprocessing: pick count landmarks and find their
+      // distances to every node (see LandmarkTable.h).  A* over this map then
+      // bounds the distance left with them as well as the straight line.
+      // Undone by the next load.
+    void selectLandmarks(int count = 16, LandmarkSelection how = LANDMARKS_AVOID);
+      // nullptr unless landmarks were selected
+    const LandmarkTable* landmarks() const;
+      // Optional preprocessing for traffic: cut the map into nested cells and
+      // work out the cost of crossing each (see CellOverlay.h), customizing
+      // side by side on pool if there is one.  Routers over this map then
+      // take the cheapest route under the current traffic, ahead of any
+      // hierarchy (which knows only lengths), and still report its miles.
+      // The distance matrix and nearestTargets go on measuring plain miles.
+      // Undone by the next load.
+    void buildOverlay(ThreadPool* pool = nullptr);
+      // Re-weight the overlay (built first if need be) from a traffic file
+      // and customize it again.  Routers may go on searching meanwhile; each
+      // query uses the traffic that was current when it started.  false if
+      // the file cannot be read, and the traffic is left as it was.
+    bool applyTraffic(const std::string& file, ThreadPool* pool = nullptr);
+      // nullptr unless an overlay was built
+    const CellOverlay* overlay() const;
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -89,16 +166,59 @@ private:
 
 class PointToPointRouterImpl;
 
+  // How a PointToPointRouter searches: A* from the start only, or A* from
+  // both ends at once, which explores far less on long routes.
+enum SearchMode
+{
+    SEARCH_UNIDIRECTIONAL, SEARCH_BIDIRECTIONAL
+};
+
 class PointToPointRouter
 {
 public:
     PointToPointRouter(const StreetMap* sm);
     ~PointToPointRouter();
+      // unidirectional unless set; chain contraction only speeds that mode
+    void setSearchMode(SearchMode mode);
+    SearchMode searchMode() const;
     DeliveryResult generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // the same route as segments viewed in place in the StreetMap
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::vector<SegmentRef>& route,
+        double& totalDistanceTravelled) const;
+      // The same, searching in workspace instead of the router's own, which
+      // leaves the router untouched: threads that each bring a workspace can
+      // share one router.  Its nodesExpanded() is then workspace's.
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::vector<SegmentRef>& route,
+        double& totalDistanceTravelled,
+        SearchWorkspace& workspace) const;
+      // Shortest road miles from every source to every target, row by row:
+      // miles[i * targets.size() + j] is from sources[i] to targets[j].  One
+      // search per source settles all of its targets and builds no route.
+      // Infinity where there is no route or a coordinate is not on the map.
+      // Given a pool, the rows are searched on its threads, all by this one
+      // router with a SearchWorkspace per thread (the caller's thread uses
+      // the router's own); the miles are the same either way.
+    void distanceMatrix(const std::vector<GeoCoord>& sources, const std::vector<GeoCoord>& targets,
+                        std::vector<double>& miles, ThreadPool* pool = nullptr) const;
+      // The k targets nearest source by road (all of them if k is 0), nearest
+      // first, each as its index in targets and its miles; ties keep the
+      // order of targets.  One search from source, stopping once k targets
+      // are settled.  Targets off the map or out of reach are left out.
+      // BAD_COORD if source is not on the map.
+    DeliveryResult nearestTargets(const GeoCoord& source, const std::vector<GeoCoord>& targets, size_t k,
+                                  std::vector<std::pair<size_t, double>>& nearest) const;
+      // nodes the last search (or matrix, all rows together) took off its open list
+    size_t nodesExpanded() const;
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -215,6 +335,15 @@ class DeliveryPlanner
 public:
     DeliveryPlanner(const StreetMap* sm);
     ~DeliveryPlanner();
+      // Look legs up in cache before routing them, and add the ones routed.
+      // A cache may be shared by any number of planners over the same map,
+      // on any threads; nullptr (the default) routes every leg.
+    void setRouteCache(RouteCache* cache);
+      // Route the legs of each plan side by side on pool's threads, each
+      // with a router of its own, then build the commands in order; the plan
+      // is the same as routing them one by one.  nullptr (the default) routes
+      // them one after another on the calling thread.
+    void setThreadPool(ThreadPool* pool);
     DeliveryResult generateDeliveryPlan(
         const GeoCoord& depot,
         const std::vector<DeliveryRequest>& deliveries,
@@ -253,20 +382,28 @@ inline double rad2deg(double rad) {
 * @param lon2d Longitude of the second point in degrees
 * @return The distance between the two points in kilometers
 */
-inline double distanceEarthKM(const GeoCoord& g1, const GeoCoord& g2) {
+inline double distanceEarthKM(double lat1d, double lon1d, double lat2d, double lon2d) {
     static const double earthRadiusKm = 6371.0;
-    double lat1r = deg2rad(g1.latitude);
-    double lon1r = deg2rad(g1.longitude);
-    double lat2r = deg2rad(g2.latitude);
-    double lon2r = deg2rad(g2.longitude);
+    double lat1r = deg2rad(lat1d);
+    double lon1r = deg2rad(lon1d);
+    double lat2r = deg2rad(lat2d);
+    double lon2r = deg2rad(lon2d);
     double u = std::sin((lat2r - lat1r) / 2);
     double v = std::sin((lon2r - lon1r) / 2);
     return 2.0 * earthRadiusKm * std::asin(std::sqrt(u * u + std::cos(lat1r) * std::cos(lat2r) * v * v));
 }
 
-inline double distanceEarthMiles(const GeoCoord& g1, const GeoCoord& g2) {
+inline double distanceEarthKM(const GeoCoord& g1, const GeoCoord& g2) {
+    return distanceEarthKM(g1.latitude, g1.longitude, g2.latitude, g2.longitude);
+}
+
+inline double distanceEarthMiles(double lat1d, double lon1d, double lat2d, double lon2d) {
     const double milesPerKm = 1 / 1.609344;
-    return distanceEarthKM(g1, g2) * milesPerKm;
+    return distanceEarthKM(lat1d, lon1d, lat2d, lon2d) * milesPerKm;
+}
+
+inline double distanceEarthMiles(const GeoCoord& g1, const GeoCoord& g2) {
+    return distanceEarthMiles(g1.latitude, g1.longitude, g2.latitude, g2.longitude);
 }
 
 inline double angleBetween2Lines(const StreetSegment& line1, const StreetSegment& line2)
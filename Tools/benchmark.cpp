@@ -0,0 +1,1820 @@
+// benchmark.cpp
+//
+// Performance benchmarks for the delivery service.  Build from the repository
+// root with
+//
+//   c++ -std=c++14 -O2 -ISources Tools/benchmark.cpp $(ls Sources/*.cpp | grep -v main.cpp) -o benchmark
+//
+// and run "./benchmark" for the list of benchmarks.
+
+#include "provided.h"
+#include "Arena.h"
+#include "CellOverlay.h"
+#include "ChainGraph.h"
+#include "ContractionHierarchy.h"
+#include "ConcurrentHashMap.h"
+#include "MapParser.h"
+#include "MapSnapshot.h"
+#include "Parallel.h"
+#include "RouteCache.h"
+#include "SearchWorkspace.h"
+#include "SpatialIndex.h"
+#include "StreetGraph.h"
+#include "ThreadPool.h"
+#include "ExpandableHashMap.h"
+#include "FlatHashMap.h"
+#include "LandmarkTable.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <new>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+  // Every allocation is counted so benchmarks can report live heap bytes.
+static atomic<size_t> liveHeapBytes(0);
+static atomic<size_t> peakHeapBytes(0);  // highest liveHeapBytes since last set
+static atomic<size_t> heapAllocations(0);
+
+  // n bytes from malloc with their size in front, or nullptr
+static void* countedAllocate(size_t n)
+{
+    size_t* p = static_cast<size_t*>(malloc(n + 16)); // 16 bytes keep the result aligned
+    if (p == nullptr) return nullptr;
+    p[0] = n;
+    size_t live = liveHeapBytes += n;
+    size_t peak = peakHeapBytes;
+    while (live > peak && !peakHeapBytes.compare_exchange_weak(peak, live)) {}
+    heapAllocations++;
+    return p + 2;
+}
+
+void* operator new(size_t n)
+{
+    void* p = countedAllocate(n);
+    if (p == nullptr) throw bad_alloc();
+    return p;
+}
+
+  // the standard library's temporary buffers (stable_sort) come from here
+void* operator new(size_t n, const nothrow_t&) noexcept
+{
+    return countedAllocate(n);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p == nullptr) return;
+    size_t* q = static_cast<size_t*>(p) - 2;
+    liveHeapBytes -= q[0];
+    free(q);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+  // hardware cache misses of this thread, where the kernel lets us count them
+class CacheMissCounter
+{
+public:
+    CacheMissCounter() : m_fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+    bool available() const { return m_fd >= 0; }
+    void start()
+    {
+#ifdef __linux__
+        if (m_fd < 0) return;
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (m_fd < 0) return -1;
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+#endif
+        return count;
+    }
+private:
+    int m_fd;
+};
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static long fileSize(const string& file)
+{
+    ifstream in(file, ios::binary | ios::ate);
+    return in ? (long)in.tellg() : -1;
+}
+
+  // Write an n x n grid of streets in mapdata.txt format: "Row Street i" runs
+  // east-west and "Column Avenue j" north-south, one segment per block.
+static bool writeSyntheticMap(const string& file, int n)
+{
+    FILE* out = fopen(file.c_str(), "w");
+    if (out == nullptr) return false;
+    for (int dir = 0; dir < 2; dir++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            fprintf(out, dir == 0 ? "Row Street %d\n%d\n" : "Column Avenue %d\n%d\n", i, n - 1);
+            for (int j = 0; j + 1 < n; j++)
+            {
+                int r1 = dir == 0 ? i : j, c1 = dir == 0 ? j : i;
+                int r2 = dir == 0 ? i : j + 1, c2 = dir == 0 ? j + 1 : i;
+                fprintf(out, "%.7f %.7f %.7f %.7f\n", 34.0 + r1 * 0.0005, -118.5 + c1 * 0.0005,
+                        34.0 + r2 * 0.0005, -118.5 + c2 * 0.0005);
+            }
+        }
+    }
+    return fclose(out) == 0;
+}
+
+  // the tokenizing the loader did before MapParser (getline on spaces, stoi,
+  // stod), without even building a graph
+static bool legacyParse(const string& file, size_t& segments)
+{
+    ifstream data(file);
+    if (!data) return false;
+    for (;;)
+    {
+        string name, amount, startLat, startLong, endLat, endLong;
+        if (!getline(data, name) || !getline(data, amount)) break;
+        for (int i = 0; i < stoi(amount); i++)
+        {
+            if (!getline(data, startLat, ' ') || !getline(data, startLong, ' ') || !getline(data, endLat, ' ') || !getline(data, endLong)) return false;
+            GeoCoord startCoord(startLat, startLong);
+            GeoCoord endCoord(endLat, endLong);
+            StreetSegment seg(startCoord, endCoord, name);
+            segments++;
+        }
+    }
+    return true;
+}
+
+  // parse [megabytes]: MB/s of MapParser on a synthetic map
+static int benchParse(int argc, char* argv[])
+{
+    double megabytes = argc > 0 ? atof(argv[0]) : 100;
+    int n = 2;
+    while (100.0 * n * n < megabytes * 1e6) // each segment line is about 50 bytes
+        n++;
+    string file = "synthetic_map.txt";
+    if (!writeSyntheticMap(file, n))
+    {
+        cout << "Unable to write " << file << endl;
+        return 1;
+    }
+    double mb = fileSize(file) / 1e6;
+    cout << "Synthetic " << n << "x" << n << " grid, " << mb << " MB" << endl;
+
+    auto start = chrono::steady_clock::now();
+    size_t segments = 0;
+    if (!legacyParse(file, segments))
+    {
+        cout << "legacy parse failed" << endl;
+        return 1;
+    }
+    double legacy = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    StreetGraphBuilder builder;
+    MapParser parser;
+    if (!parser.parse(file, builder))
+    {
+        cout << parser.error() << endl;
+        return 1;
+    }
+    double parse = secondsSince(start);
+    start = chrono::steady_clock::now();
+    StreetGraph graph;
+    builder.build(graph);
+    double build = secondsSince(start);
+
+    cout << "getline/stod, no graph:   " << legacy << " s, " << mb / legacy << " MB/s" << endl;
+    cout << "MapParser with interning: " << parse << " s, " << mb / parse << " MB/s ("
+         << graph.nodeCount() << " nodes, " << graph.edgeCount() << " edges)" << endl;
+    cout << "CSR build:                " << build << " s" << endl;
+    remove(file.c_str());
+    return 0;
+}
+
+static bool sameGraph(const StreetGraph& g1, const StreetGraph& g2)
+{
+    const StreetGraphArrays& a = g1.arrays();
+    const StreetGraphArrays& b = g2.arrays();
+    if (a.nodeCount != b.nodeCount || a.edgeCount != b.edgeCount || a.nameCount != b.nameCount ||
+        a.tableSize != b.tableSize || a.textSize != b.textSize)
+        return false;
+    return memcmp(a.latitudes, b.latitudes, a.nodeCount * sizeof(double)) == 0 &&
+           memcmp(a.longitudes, b.longitudes, a.nodeCount * sizeof(double)) == 0 &&
+           memcmp(a.coordText, b.coordText, 2 * a.nodeCount * sizeof(uint32_t)) == 0 &&
+           memcmp(a.edgeOffsets, b.edgeOffsets, (a.nodeCount + 1) * sizeof(EdgeId)) == 0 &&
+           memcmp(a.edgeTargets, b.edgeTargets, a.edgeCount * sizeof(NodeId)) == 0 &&
+           memcmp(a.edgeLengths, b.edgeLengths, a.edgeCount * sizeof(double)) == 0 &&
+           memcmp(a.edgeNames, b.edgeNames, a.edgeCount * sizeof(uint32_t)) == 0 &&
+           memcmp(a.edgeTwins, b.edgeTwins, a.edgeCount * sizeof(EdgeId)) == 0 &&
+           memcmp(a.nameText, b.nameText, a.nameCount * sizeof(uint32_t)) == 0 &&
+           memcmp(a.table, b.table, a.tableSize * sizeof(NodeId)) == 0 &&
+           memcmp(a.text, b.text, a.textSize) == 0;
+}
+
+  // load [megabytes] [max threads]: parallel MapParser scaling on a synthetic map
+static int benchLoad(int argc, char* argv[])
+{
+    double megabytes = argc > 0 ? atof(argv[0]) : 200;
+    unsigned int maxThreads = argc > 1 ? atoi(argv[1]) : defaultThreadCount();
+    int n = 2;
+    while (100.0 * n * n < megabytes * 1e6)
+        n++;
+    string file = "synthetic_map.txt";
+    if (!writeSyntheticMap(file, n))
+    {
+        cout << "Unable to write " << file << endl;
+        return 1;
+    }
+    double mb = fileSize(file) / 1e6;
+    cout << "Synthetic " << n << "x" << n << " grid, " << mb << " MB" << endl;
+
+    StreetGraph serial;
+    double serialSeconds = 0;
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        auto start = chrono::steady_clock::now();
+        StreetGraphBuilder builder;
+        MapParser parser;
+        if (!parser.parse(file, builder, threads))
+        {
+            cout << parser.error() << endl;
+            return 1;
+        }
+        StreetGraph parallel;
+        StreetGraph& graph = threads == 1 ? serial : parallel;
+        builder.build(graph);
+        double seconds = secondsSince(start);
+        if (threads == 1)
+            serialSeconds = seconds;
+        cout << threads << " thread(s): " << seconds << " s, " << mb / seconds << " MB/s, speedup "
+             << serialSeconds / seconds;
+        if (threads > 1)
+            cout << (sameGraph(serial, graph) ? ", identical to serial" : ", DIFFERS FROM SERIAL");
+        cout << endl;
+    }
+    remove(file.c_str());
+    return 0;
+}
+
+  // the map as StreetMapImpl::load used to store it: every segment, and its
+  // reverse, as a full StreetSegment in a GeoCoord-keyed ExpandableHashMap
+static bool legacyLoad(const string& file, ExpandableHashMap<GeoCoord, vector<StreetSegment>>& coordMap)
+{
+    ifstream data(file);
+    if (!data) return false;
+    for (;;)
+    {
+        string name, amount, startLat, startLong, endLat, endLong;
+        if (!getline(data, name) || !getline(data, amount)) break;
+        for (int i = 0; i < stoi(amount); i++)
+        {
+            if (!getline(data, startLat, ' ') || !getline(data, startLong, ' ') || !getline(data, endLat, ' ') || !getline(data, endLong)) return false;
+            GeoCoord startCoord(startLat, startLong);
+            GeoCoord endCoord(endLat, endLong);
+            StreetSegment segs[2] = { StreetSegment(startCoord, endCoord, name), StreetSegment(endCoord, startCoord, name) };
+            for (const StreetSegment& seg : segs)
+            {
+                vector<StreetSegment>* found = coordMap.find(seg.start);
+                if (found != nullptr)
+                    found->push_back(seg);
+                else
+                    coordMap.associate(seg.start, vector<StreetSegment>(1, seg));
+            }
+        }
+    }
+    return true;
+}
+
+  // memory [mapdata.txt]: heap used by the old and the current map representation
+static int benchMemory(int argc, char* argv[])
+{
+    string file = argc > 0 ? argv[0] : "Sources/mapdata.txt";
+    size_t before = liveHeapBytes;
+    size_t legacyBytes;
+    {
+        ExpandableHashMap<GeoCoord, vector<StreetSegment>> coordMap;
+        if (!legacyLoad(file, coordMap))
+        {
+            cout << "Unable to load " << file << endl;
+            return 1;
+        }
+        legacyBytes = liveHeapBytes - before;
+    }
+
+    before = liveHeapBytes;
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    size_t graphBytes = liveHeapBytes - before;
+    const StreetGraph& graph = sm.graph();
+
+    cout << file << ": " << graph.nodeCount() << " nodes, " << graph.edgeCount() << " directed segments, "
+         << graph.nameCount() << " street names" << endl;
+    cout << "GeoCoord -> vector<StreetSegment> map: " << legacyBytes / 1024 << " KiB of heap" << endl;
+    cout << "StreetGraph:                           " << graphBytes / 1024 << " KiB of heap ("
+         << graph.memoryUsage() / 1024 << " KiB of arrays)" << endl;
+    cout << "Reduction:                             " << (double)legacyBytes / graphBytes << "x" << endl;
+    return 0;
+}
+
+  // snap [mapdata.txt] [points]: SpatialIndex against a scan of every node
+static int benchSnap(int argc, char* argv[])
+{
+    string file = argc > 0 ? argv[0] : "Sources/mapdata.txt";
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    const SpatialIndex& index = sm.spatialIndex();
+    if (graph.nodeCount() == 0)
+    {
+        cout << file << " has no streets" << endl;
+        return 1;
+    }
+
+    // GPS-like points: map nodes moved up to about 100 meters
+    mt19937 random(42);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    uniform_real_distribution<double> jitter(-0.001, 0.001);
+    vector<GeoCoord> points(count);
+    for (GeoCoord& p : points)
+    {
+        NodeId n = anyNode(random);
+        p.latitude = graph.latitude(n) + jitter(random);
+        p.longitude = graph.longitude(n) + jitter(random);
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<NodeId> scanned(count);
+    double scannedMiles = 0;
+    for (int i = 0; i < count; i++)
+    {
+        double best = 1e300;
+        for (NodeId n = 0; n < graph.nodeCount(); n++)
+        {
+            double miles = distanceEarthMiles(points[i].latitude, points[i].longitude, graph.latitude(n), graph.longitude(n));
+            if (miles < best)
+            {
+                best = miles;
+                scanned[i] = n;
+            }
+        }
+        scannedMiles += best;
+    }
+    double scan = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    vector<NodeId> indexed;
+    index.nearestNodes(points, indexed);
+    double grid = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    double segmentMiles = 0;
+    for (const GeoCoord& p : points)
+    {
+        SegmentRef seg;
+        double miles;
+        index.nearestSegment(p.latitude, p.longitude, seg, miles);
+        segmentMiles += miles;
+    }
+    double segments = secondsSince(start);
+
+    // the projection may break a near tie differently from the haversine scan
+    int same = 0;
+    double indexedMiles = 0;
+    for (int i = 0; i < count; i++)
+    {
+        same += indexed[i] == scanned[i];
+        indexedMiles += distanceEarthMiles(points[i].latitude, points[i].longitude,
+                                           graph.latitude(indexed[i]), graph.longitude(indexed[i]));
+    }
+    cout << count << " points on " << graph.nodeCount() << " nodes" << endl;
+    cout << "scan every node: " << scan << " s, " << count / scan << " snaps/s" << endl;
+    cout << "grid:            " << grid << " s, " << count / grid << " snaps/s, speedup " << scan / grid << endl;
+    cout << "same node for " << same << " of " << count << " points; mean distance " << scannedMiles / count
+         << " miles scanned, " << indexedMiles / count << " indexed" << endl;
+    cout << "nearest segment: " << segments << " s, " << count / segments << " queries/s, mean distance "
+         << segmentMiles / count << " miles" << endl;
+    return 0;
+}
+
+  // Route between the same coordinate pairs on snapshots of one map with its
+  // nodes in three orders.  The snapshots are loaded as they are, so the
+  // order is exactly the one written.
+static bool benchRouteOrders(const string& mapFile, int queries)
+{
+    StreetGraphBuilder builder;
+    MapParser parser;
+    if (!parser.parse(mapFile, builder))
+    {
+        cout << parser.error() << endl;
+        return false;
+    }
+    StreetGraph graph;
+    builder.build(graph);
+    uint32_t n = graph.nodeCount();
+    if (n == 0) return false;
+
+    // start/end pairs at most two miles apart, so even the slowest order
+    // finishes in reasonable time
+    mt19937 random(7);
+    uniform_int_distribution<NodeId> anyNode(0, n - 1);
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    for (int tries = 0; (int)pairs.size() < queries && tries < 1000 * queries; tries++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        if (distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b)) < 2)
+            pairs.push_back(make_pair(graph.coord(a), graph.coord(b)));
+    }
+
+    vector<NodeId> shuffled(n);
+    for (NodeId i = 0; i < n; i++)
+        shuffled[i] = i;
+    shuffle(shuffled.begin(), shuffled.end(), random);
+    vector<NodeId> hilbert = hilbertOrder(graph);
+
+    struct Variant { const char* name; const vector<NodeId>* order; };
+    const Variant variants[] = {
+        { "random (hash order)", &shuffled },
+        { "file order", nullptr },
+        { "Hilbert curve", &hilbert },
+    };
+    cout << mapFile << ": " << n << " nodes, " << pairs.size() << " routes" << endl;
+    CacheMissCounter misses;
+    string snapshot = "route_order.snap";
+    double fileSeconds = 0;
+    for (const Variant& v : variants)
+    {
+        if (v.order != nullptr)
+            graph.renumber(*v.order);
+        if (!writeMapSnapshot(graph, snapshot))
+        {
+            cout << "Unable to write " << snapshot << endl;
+            return false;
+        }
+        if (v.order != nullptr)
+        {
+            vector<NodeId> undo(n); // back to file order for the next variant
+            for (NodeId i = 0; i < n; i++)
+                undo[(*v.order)[i]] = i;
+            graph.renumber(undo);
+        }
+
+        StreetMap sm;
+        if (!sm.load(snapshot)) return false;
+        PointToPointRouter router(&sm);
+        vector<SegmentRef> route;
+        double miles, total = 0;
+        auto start = chrono::steady_clock::now();
+        misses.start();
+        for (const auto& p : pairs)
+        {
+            router.generatePointToPointRoute(p.first, p.second, route, miles);
+            total += miles;
+        }
+        long long missCount = misses.stop();
+        double seconds = secondsSince(start);
+        if (v.order == nullptr)
+            fileSeconds = seconds;
+        cout << "  " << v.name << ": " << pairs.size() / seconds << " routes/s";
+        if (missCount >= 0)
+            cout << ", " << missCount / (double)pairs.size() << " cache misses/route";
+        cout << ", " << total << " miles";
+        if (fileSeconds > 0 && v.order != nullptr)
+            cout << ", speedup over file order " << fileSeconds / seconds;
+        cout << endl;
+    }
+    if (!misses.available())
+        cout << "  (cache miss counters are not available here)" << endl;
+    remove(snapshot.c_str());
+    return true;
+}
+
+  // route [queries] [grid side]: routing speed by node order, on mapdata.txt
+  // and on a synthetic grid
+static int benchRoute(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 200;
+    int side = argc > 1 ? atoi(argv[1]) : 300;
+    if (!benchRouteOrders("Sources/mapdata.txt", queries))
+        return 1;
+    string file = "synthetic_map.txt";
+    if (!writeSyntheticMap(file, side))
+    {
+        cout << "Unable to write " << file << endl;
+        return 1;
+    }
+    bool ok = benchRouteOrders(file, queries);
+    remove(file.c_str());
+    return ok ? 0 : 1;
+}
+
+  // length of the shortest route from start to end by plain Dijkstra, the
+  // yardstick for the routers; infinity if there is none.  With weights,
+  // the cost of the cheapest route with edge e costing (*weights)[e].
+static double referenceDistance(const StreetGraph& graph, NodeId start, NodeId end,
+                                const vector<double>* weights = nullptr)
+{
+    vector<double> dist(graph.nodeCount(), numeric_limits<double>::infinity());
+    typedef pair<double, NodeId> Entry;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+    dist[start] = 0;
+    open.push(Entry(0, start));
+    while (!open.empty())
+    {
+        Entry top = open.top();
+        open.pop();
+        if (top.second == end) return top.first;
+        if (top.first > dist[top.second]) continue;
+        for (EdgeId e = graph.edgeBegin(top.second); e < graph.edgeEnd(top.second); e++)
+        {
+            double d = top.first + (weights != nullptr ? (*weights)[e] : graph.edgeLength(e));
+            if (d < dist[graph.edgeTarget(e)])
+            {
+                dist[graph.edgeTarget(e)] = d;
+                open.push(Entry(d, graph.edgeTarget(e)));
+            }
+        }
+    }
+    return numeric_limits<double>::infinity();
+}
+
+  // true if route is a connected walk from start to end of the given length
+static bool validRoute(const vector<SegmentRef>& route, NodeId start, NodeId end, double miles)
+{
+    NodeId at = start;
+    double length = 0;
+    for (const SegmentRef& seg : route)
+    {
+        if (seg.startNode() != at) return false;
+        at = seg.endNode();
+        length += seg.length();
+    }
+    return at == end && fabs(length - miles) < 1e-9;
+}
+
+  // chains [queries]: routing on mapdata.txt with and without degree-2 chains contracted
+static int benchChains(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 200;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(11);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    vector<double> reference;
+    for (int tries = 0; (int)pairs.size() < queries && tries < 1000 * queries; tries++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        if (distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b)) < 2)
+        {
+            pairs.push_back(make_pair(a, b));
+            reference.push_back(referenceDistance(graph, a, b));
+        }
+    }
+
+    PointToPointRouter router(&sm);
+    for (int contracted = 0; contracted < 2; contracted++)
+    {
+        if (contracted)
+        {
+            auto start = chrono::steady_clock::now();
+            sm.contractChains();
+            const ChainGraph& chains = *sm.chainGraph();
+            cout << "contraction: " << secondsSince(start) << " s, " << graph.nodeCount() << " nodes -> "
+                 << chains.junctionCount() << " junctions, " << graph.edgeCount() << " segments -> "
+                 << chains.chainCount() << " chains" << endl;
+        }
+        size_t expanded = 0;
+        int optimal = 0, valid = 0;
+        vector<SegmentRef> route;
+        double miles;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            DeliveryResult result = router.generatePointToPointRoute(graph.coord(pairs[i].first), graph.coord(pairs[i].second), route, miles);
+            expanded += router.nodesExpanded();
+            if (result != DELIVERY_SUCCESS)
+            {
+                valid += reference[i] == numeric_limits<double>::infinity();
+                optimal += reference[i] == numeric_limits<double>::infinity();
+                continue;
+            }
+            valid += validRoute(route, pairs[i].first, pairs[i].second, miles);
+            optimal += fabs(miles - reference[i]) < 1e-9;
+        }
+        double seconds = secondsSince(start);
+        cout << (contracted ? "chains:      " : "full graph:  ") << pairs.size() / seconds << " routes/s, "
+             << expanded / (double)pairs.size() << " nodes expanded/route, " << valid << " of " << pairs.size()
+             << " routes valid, " << optimal << " shortest" << endl;
+    }
+    return 0;
+}
+
+  // astar [queries]: full-graph A* on mapdata.txt between random nodes at any
+  // distance, timed against the reference Dijkstra and checked against it
+static int benchAStar(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 500;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(13);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    for (int i = 0; i < queries; i++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        pairs.push_back(make_pair(a, b));
+    }
+
+    vector<double> reference;
+    auto start = chrono::steady_clock::now();
+    for (const auto& p : pairs)
+        reference.push_back(referenceDistance(graph, p.first, p.second));
+    double dijkstraSeconds = secondsSince(start);
+
+    PointToPointRouter router(&sm);
+    size_t expanded = 0;
+    int optimal = 0, valid = 0;
+    vector<SegmentRef> route;
+    double miles, total = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        DeliveryResult result = router.generatePointToPointRoute(graph.coord(pairs[i].first), graph.coord(pairs[i].second), route, miles);
+        expanded += router.nodesExpanded();
+        if (result != DELIVERY_SUCCESS)
+        {
+            valid += reference[i] == numeric_limits<double>::infinity();
+            optimal += reference[i] == numeric_limits<double>::infinity();
+            continue;
+        }
+        total += miles;
+        valid += validRoute(route, pairs[i].first, pairs[i].second, miles);
+        optimal += fabs(miles - reference[i]) < 1e-9;
+    }
+    double seconds = secondsSince(start);
+    cout << file << ": " << pairs.size() << " routes, " << total / pairs.size() << " miles on average" << endl;
+    cout << "reference Dijkstra: " << pairs.size() / dijkstraSeconds << " routes/s" << endl;
+    cout << "A*:                 " << pairs.size() / seconds << " routes/s, "
+         << expanded / (double)pairs.size() << " nodes expanded/route, " << valid << " of " << pairs.size()
+         << " routes valid, " << optimal << " shortest" << endl;
+    return 0;
+}
+
+  // bidirectional [queries] [min miles]: unidirectional against bidirectional
+  // A* on mapdata.txt, between random nodes at least min miles apart
+static int benchBidirectional(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 500;
+    double minMiles = argc > 1 ? atof(argv[1]) : 4;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(17);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    vector<double> reference;
+    for (int tries = 0; (int)pairs.size() < queries && tries < 1000 * queries; tries++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        if (distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b)) >= minMiles)
+        {
+            pairs.push_back(make_pair(a, b));
+            reference.push_back(referenceDistance(graph, a, b));
+        }
+    }
+    cout << file << ": " << pairs.size() << " routes between nodes at least " << minMiles << " miles apart" << endl;
+
+    struct Mode { const char* name; SearchMode mode; };
+    const Mode modes[] = {
+        { "unidirectional", SEARCH_UNIDIRECTIONAL },
+        { "bidirectional ", SEARCH_BIDIRECTIONAL },
+    };
+    PointToPointRouter router(&sm);
+    for (const Mode& m : modes)
+    {
+        router.setSearchMode(m.mode);
+        size_t expanded = 0;
+        int optimal = 0, valid = 0;
+        vector<SegmentRef> route;
+        double miles;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            DeliveryResult result = router.generatePointToPointRoute(graph.coord(pairs[i].first), graph.coord(pairs[i].second), route, miles);
+            expanded += router.nodesExpanded();
+            if (result != DELIVERY_SUCCESS)
+            {
+                valid += reference[i] == numeric_limits<double>::infinity();
+                optimal += reference[i] == numeric_limits<double>::infinity();
+                continue;
+            }
+            valid += validRoute(route, pairs[i].first, pairs[i].second, miles);
+            optimal += fabs(miles - reference[i]) < 1e-9;
+        }
+        double seconds = secondsSince(start);
+        cout << m.name << ": " << pairs.size() / seconds << " routes/s, "
+             << expanded / (double)pairs.size() << " nodes expanded/route, " << valid << " of " << pairs.size()
+             << " routes valid, " << optimal << " shortest" << endl;
+    }
+    return 0;
+}
+
+  // hierarchy [queries]: contraction hierarchy preprocessing on mapdata.txt,
+  // then queries between random nodes against A* and the reference Dijkstra
+static int benchHierarchy(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 1000;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(19);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    vector<double> reference;
+    for (int i = 0; i < queries; i++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        pairs.push_back(make_pair(a, b));
+        reference.push_back(referenceDistance(graph, a, b));
+    }
+
+    // A* first, while the map has no hierarchy
+    PointToPointRouter router(&sm);
+    vector<SegmentRef> route;
+    double miles;
+    auto start = chrono::steady_clock::now();
+    for (const auto& p : pairs)
+        router.generatePointToPointRoute(graph.coord(p.first), graph.coord(p.second), route, miles);
+    double aStarSeconds = secondsSince(start);
+
+    size_t before = liveHeapBytes;
+    peakHeapBytes = before;
+    start = chrono::steady_clock::now();
+    sm.buildHierarchy();
+    double buildSeconds = secondsSince(start);
+    const ContractionHierarchy& hierarchy = *sm.hierarchy();
+    cout << file << ": " << graph.nodeCount() << " nodes, " << graph.edgeCount() << " segments" << endl;
+    cout << "preprocessing: " << buildSeconds << " s, peak " << (peakHeapBytes - before) / 1024 << " KiB of working memory, "
+         << hierarchy.arcCount() << " arcs (" << hierarchy.shortcutCount() << " shortcuts), "
+         << hierarchy.memoryUsage() / 1024 << " KiB kept" << endl;
+
+    string saved = "hierarchy.ch";
+    if (!sm.saveHierarchy(saved))
+    {
+        cout << "Unable to write " << saved << endl;
+        return 1;
+    }
+    start = chrono::steady_clock::now();
+    bool loaded = sm.loadHierarchy(saved);
+    double loadSeconds = secondsSince(start);
+    cout << "saved to " << fileSize(saved) / 1024 << " KiB, loaded back in " << loadSeconds * 1000 << " ms"
+         << (loaded ? "" : " (FAILED)") << endl;
+    remove(saved.c_str());
+    if (!loaded) return 1;
+
+    size_t expanded = 0;
+    int optimal = 0, valid = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        DeliveryResult result = router.generatePointToPointRoute(graph.coord(pairs[i].first), graph.coord(pairs[i].second), route, miles);
+        expanded += router.nodesExpanded();
+        if (result != DELIVERY_SUCCESS)
+        {
+            valid += reference[i] == numeric_limits<double>::infinity();
+            optimal += reference[i] == numeric_limits<double>::infinity();
+            continue;
+        }
+        valid += validRoute(route, pairs[i].first, pairs[i].second, miles);
+        optimal += fabs(miles - reference[i]) < 1e-9;
+    }
+    double seconds = secondsSince(start);
+    cout << "A*:        " << aStarSeconds / pairs.size() * 1e6 << " us/route" << endl;
+    cout << "hierarchy: " << seconds / pairs.size() * 1e6 << " us/route, unpacking included, "
+         << expanded / (double)pairs.size() << " nodes settled/route, " << valid << " of " << pairs.size()
+         << " routes valid, " << optimal << " shortest" << endl;
+    return 0;
+}
+
+  // landmarks [queries] [count]: A* on mapdata.txt with the straight-line
+  // heuristic against ALT with farthest and with avoid landmarks
+static int benchLandmarks(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 500;
+    int count = argc > 1 ? atoi(argv[1]) : 16;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(23);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    vector<double> reference;
+    for (int i = 0; i < queries; i++)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        pairs.push_back(make_pair(a, b));
+        reference.push_back(referenceDistance(graph, a, b));
+    }
+    cout << file << ": " << pairs.size() << " routes between random nodes, " << count << " landmarks" << endl;
+
+    struct Variant { const char* name; int landmarks; LandmarkSelection how; };
+    const Variant variants[] = {
+        { "straight line    ", 0, LANDMARKS_AVOID },
+        { "farthest landmarks", count, LANDMARKS_FARTHEST },
+        { "avoid landmarks   ", count, LANDMARKS_AVOID },
+    };
+    PointToPointRouter router(&sm);
+    size_t baseline = 0;
+    for (const Variant& v : variants)
+    {
+        if (v.landmarks > 0)
+        {
+            auto start = chrono::steady_clock::now();
+            sm.selectLandmarks(v.landmarks, v.how);
+            cout << "  selecting " << v.name << " took " << secondsSince(start) << " s, "
+                 << sm.landmarks()->memoryUsage() / 1024 << " KiB of distances" << endl;
+        }
+        size_t expanded = 0;
+        int optimal = 0, valid = 0;
+        vector<SegmentRef> route;
+        double miles;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            DeliveryResult result = router.generatePointToPointRoute(graph.coord(pairs[i].first), graph.coord(pairs[i].second), route, miles);
+            expanded += router.nodesExpanded();
+            if (result != DELIVERY_SUCCESS)
+            {
+                valid += reference[i] == numeric_limits<double>::infinity();
+                optimal += reference[i] == numeric_limits<double>::infinity();
+                continue;
+            }
+            valid += validRoute(route, pairs[i].first, pairs[i].second, miles);
+            optimal += fabs(miles - reference[i]) < 1e-9;
+        }
+        double seconds = secondsSince(start);
+        if (baseline == 0)
+            baseline = expanded;
+        cout << v.name << ": " << pairs.size() / seconds << " routes/s, "
+             << expanded / (double)pairs.size() << " nodes expanded/route (" << 100.0 * expanded / baseline
+             << "%), " << valid << " of " << pairs.size() << " routes valid, " << optimal << " shortest" << endl;
+    }
+    return 0;
+}
+
+  // matrix [stops]: the road-distance matrix between random stops on
+  // mapdata.txt, from one search per stop against one route per pair
+static int benchMatrix(int argc, char* argv[])
+{
+    int stops = argc > 0 ? atoi(argv[0]) : 30;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(31);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<GeoCoord> coords;
+    for (int i = 0; i < stops; i++)
+        coords.push_back(graph.coord(anyNode(random)));
+
+    PointToPointRouter router(&sm);
+    vector<double> matrix;
+    auto start = chrono::steady_clock::now();
+    router.distanceMatrix(coords, coords, matrix);
+    double matrixSeconds = secondsSince(start);
+    size_t matrixExpanded = router.nodesExpanded();
+
+    size_t pairExpanded = 0;
+    int same = 0;
+    list<StreetSegment> route;
+    double miles;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < stops; i++)
+    {
+        for (int j = 0; j < stops; j++)
+        {
+            DeliveryResult result = router.generatePointToPointRoute(coords[i], coords[j], route, miles);
+            pairExpanded += router.nodesExpanded();
+            double expected = result == DELIVERY_SUCCESS ? miles : numeric_limits<double>::infinity();
+            same += matrix[i * stops + j] == expected || fabs(matrix[i * stops + j] - expected) < 1e-9;
+        }
+    }
+    double pairSeconds = secondsSince(start);
+    cout << file << ": " << stops << " x " << stops << " matrix" << endl;
+    cout << "one search per stop: " << matrixSeconds * 1000 << " ms, " << matrixExpanded << " nodes expanded" << endl;
+    cout << "one route per pair:  " << pairSeconds * 1000 << " ms, " << pairExpanded << " nodes expanded" << endl;
+    cout << same << " of " << stops * stops << " distances agree" << endl;
+    return 0;
+}
+
+  // nearest [targets] [k]: the k of that many random stops on mapdata.txt
+  // nearest a courier by road, from one search against a route to each
+static int benchNearest(int argc, char* argv[])
+{
+    int count = argc > 0 ? atoi(argv[0]) : 200;
+    int k = argc > 1 ? atoi(argv[1]) : 5;
+    int couriers = 50;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(43);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<GeoCoord> targets;
+    for (int i = 0; i < count; i++)
+        targets.push_back(graph.coord(anyNode(random)));
+    vector<GeoCoord> sources;
+    for (int i = 0; i < couriers; i++)
+        sources.push_back(graph.coord(anyNode(random)));
+    cout << file << ": " << couriers << " couriers, the " << k << " nearest of " << count << " stops" << endl;
+
+    PointToPointRouter router(&sm);
+    vector<vector<pair<size_t, double>>> found(couriers);
+    size_t expanded = 0;
+    auto start = chrono::steady_clock::now();
+    for (int c = 0; c < couriers; c++)
+    {
+        router.nearestTargets(sources[c], targets, k, found[c]);
+        expanded += router.nodesExpanded();
+    }
+    double searchSeconds = secondsSince(start);
+
+    size_t routeExpanded = 0;
+    int same = 0;
+    vector<SegmentRef> route;
+    double miles;
+    start = chrono::steady_clock::now();
+    for (int c = 0; c < couriers; c++)
+    {
+        vector<pair<size_t, double>> all;
+        for (int i = 0; i < count; i++)
+        {
+            if (router.generatePointToPointRoute(sources[c], targets[i], route, miles) == DELIVERY_SUCCESS)
+                all.push_back(make_pair((size_t)i, miles));
+            routeExpanded += router.nodesExpanded();
+        }
+        stable_sort(all.begin(), all.end(), [](const pair<size_t, double>& a, const pair<size_t, double>& b) {
+            return a.second < b.second;
+        });
+        if (k > 0 && all.size() > (size_t)k) all.resize(k);
+        bool agree = all.size() == found[c].size();
+        for (size_t i = 0; agree && i < all.size(); i++)
+            agree = fabs(all[i].second - found[c][i].second) < 1e-9;
+        same += agree;
+    }
+    double routeSeconds = secondsSince(start);
+    cout << "one search per courier: " << searchSeconds / couriers * 1000 << " ms, "
+         << expanded / (double)couriers << " nodes expanded" << endl;
+    cout << "one route per stop:     " << routeSeconds / couriers * 1000 << " ms, "
+         << routeExpanded / (double)couriers << " nodes expanded" << endl;
+    cout << same << " of " << couriers << " couriers given the same nearest stops" << endl;
+    return 0;
+}
+
+  // the commands of a plan as one string, for comparing plans
+static string planText(const vector<DeliveryCommand>& commands, double miles)
+{
+    string text;
+    for (const DeliveryCommand& c : commands)
+        text += c.description() + "\n";
+    return text + to_string(miles);
+}
+
+  // cache [plans] [capacity]: delivery plans from one depot to a dozen
+  // buildings on mapdata.txt, two planners with and without a shared route cache
+static int benchRouteCache(int argc, char* argv[])
+{
+    int plans = argc > 0 ? atoi(argv[0]) : 200;
+    int capacity = argc > 1 ? atoi(argv[1]) : 1024;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(29);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    GeoCoord depot = graph.coord(anyNode(random));
+    vector<GeoCoord> buildings;
+    for (int i = 0; i < 12; i++)
+        buildings.push_back(graph.coord(anyNode(random)));
+    uniform_int_distribution<size_t> anyBuilding(0, buildings.size() - 1);
+    vector<vector<DeliveryRequest>> batches(plans);
+    for (auto& batch : batches)
+    {
+        for (int i = 0; i < 6; i++)
+            batch.push_back(DeliveryRequest("parcel " + to_string(i), buildings[anyBuilding(random)]));
+    }
+    cout << file << ": " << plans << " plans of 6 deliveries to 12 buildings, cache of " << capacity << " legs" << endl;
+
+    RouteCache cache(&sm, capacity);
+    DeliveryPlanner first(&sm), second(&sm);
+    vector<string> uncached;
+    for (int cached = 0; cached < 2; cached++)
+    {
+        first.setRouteCache(cached ? &cache : nullptr);
+        second.setRouteCache(cached ? &cache : nullptr);
+        int same = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < plans; i++)
+        {
+            const DeliveryPlanner& planner = i % 2 == 0 ? first : second;
+            vector<DeliveryCommand> commands;
+            double miles = 0;
+            planner.generateDeliveryPlan(depot, batches[i], commands, miles);
+            string text = planText(commands, miles);
+            if (!cached)
+                uncached.push_back(text);
+            else
+                same += text == uncached[i];
+        }
+        double seconds = secondsSince(start);
+        cout << (cached ? "shared cache: " : "no cache:     ") << plans / seconds << " plans/s";
+        if (cached)
+            cout << ", " << cache.hits() << " hits, " << cache.misses() << " misses, " << cache.evictions()
+                 << " evictions, " << same << " of " << plans << " plans identical to uncached";
+        cout << endl;
+    }
+
+    if (!sm.load(file)) return 1;
+    vector<DeliveryCommand> commands;
+    double miles = 0;
+    first.generateDeliveryPlan(depot, batches[0], commands, miles);
+    cout << "after reloading the map: " << cache.invalidations() << " invalidation, " << cache.size()
+         << " legs cached, plan " << (planText(commands, miles) == uncached[0] ? "unchanged" : "CHANGED") << endl;
+    return 0;
+}
+
+  // pool [stops] [threads]: one plan delivering to that many random stops on
+  // mapdata.txt and their distance matrix, serially and on a thread pool
+static int benchPool(int argc, char* argv[])
+{
+    int stops = argc > 0 ? atoi(argv[0]) : 30;
+    unsigned int threads = argc > 1 ? atoi(argv[1]) : defaultThreadCount();
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(37);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    GeoCoord depot = graph.coord(anyNode(random));
+    vector<DeliveryRequest> deliveries;
+    vector<GeoCoord> coords(1, depot);
+    for (int i = 0; i < stops; i++)
+    {
+        // only stops the depot can reach, or the plan ends at the first other one
+        NodeId stop = anyNode(random);
+        while (referenceDistance(graph, graph.findNode(depot), stop) == numeric_limits<double>::infinity())
+            stop = anyNode(random);
+        deliveries.push_back(DeliveryRequest("parcel " + to_string(i), graph.coord(stop)));
+        coords.push_back(deliveries.back().location);
+    }
+    ThreadPool pool(threads);
+    cout << file << ": a plan of " << stops << " deliveries, pool of " << pool.threadCount() << " threads ("
+         << defaultThreadCount() << " hardware threads on this machine)" << endl;
+
+    // the longest leg bounds what routing the legs side by side can reach
+    DeliveryOptimizer optimizer(&sm);
+    vector<DeliveryRequest> ordered = deliveries;
+    double oldCrow, newCrow;
+    optimizer.optimizeDeliveryOrder(depot, ordered, oldCrow, newCrow);
+    vector<GeoCoord> legStops(1, depot);
+    for (const DeliveryRequest& d : ordered)
+        legStops.push_back(d.location);
+    legStops.push_back(depot);
+    // every time below is the best of a few runs, the first warming up
+    const int runs = 5;
+    PointToPointRouter router(&sm);
+    vector<SegmentRef> route;
+    double miles, longestLeg = 0, allLegs = 0;
+    for (size_t i = 0; i + 1 < legStops.size(); i++)
+    {
+        double best = numeric_limits<double>::infinity();
+        for (int r = 0; r < runs; r++)
+        {
+            auto start = chrono::steady_clock::now();
+            router.generatePointToPointRoute(legStops[i], legStops[i + 1], route, miles);
+            best = min(best, secondsSince(start));
+        }
+        longestLeg = max(longestLeg, best);
+        allLegs += best;
+    }
+
+    DeliveryPlanner planner(&sm);
+    string texts[2];
+    double planSeconds[2];
+    for (int pooled = 0; pooled < 2; pooled++)
+    {
+        planner.setThreadPool(pooled ? &pool : nullptr);
+        planSeconds[pooled] = numeric_limits<double>::infinity();
+        for (int r = 0; r < runs; r++)
+        {
+            vector<DeliveryCommand> commands;
+            double planMiles = 0;
+            auto start = chrono::steady_clock::now();
+            planner.generateDeliveryPlan(depot, deliveries, commands, planMiles);
+            planSeconds[pooled] = min(planSeconds[pooled], secondsSince(start));
+            texts[pooled] = planText(commands, planMiles);
+        }
+    }
+    cout << "legs one by one: " << allLegs * 1000 << " ms, longest leg " << longestLeg * 1000 << " ms" << endl;
+    cout << "plan, serial: " << planSeconds[0] * 1000 << " ms; on the pool: " << planSeconds[1] * 1000
+         << " ms, " << (texts[0] == texts[1] ? "identical" : "DIFFERENT") << endl;
+
+    vector<double> matrices[2];
+    double matrixSeconds[2];
+    for (int pooled = 0; pooled < 2; pooled++)
+    {
+        matrixSeconds[pooled] = numeric_limits<double>::infinity();
+        for (int r = 0; r < runs; r++)
+        {
+            auto start = chrono::steady_clock::now();
+            router.distanceMatrix(coords, coords, matrices[pooled], pooled ? &pool : nullptr);
+            matrixSeconds[pooled] = min(matrixSeconds[pooled], secondsSince(start));
+        }
+    }
+    cout << coords.size() << " x " << coords.size() << " matrix, serial: " << matrixSeconds[0] * 1000
+         << " ms; on the pool: " << matrixSeconds[1] * 1000 << " ms, "
+         << (matrices[0] == matrices[1] ? "identical" : "DIFFERENT") << endl;
+    return 0;
+}
+
+  // insert every key, look each up once, then look up as many missing keys;
+  // prints one line of results for map type Map
+template<typename Map, typename Key, typename Value>
+static void benchMapWorkload(const char* label, const vector<Key>& keys, const vector<Key>& missing,
+                             const Value& value, int rounds)
+{
+    double insert = 0, hit = 0, miss = 0;
+    size_t allocations = 0, found = 0;
+    for (int round = 0; round < rounds; round++)
+    {
+        Map map;
+        size_t before = heapAllocations;
+        auto start = chrono::steady_clock::now();
+        for (const Key& k : keys)
+            map.associate(k, value);
+        insert += secondsSince(start);
+        allocations += heapAllocations - before;
+        start = chrono::steady_clock::now();
+        for (const Key& k : keys)
+            found += map.find(k) != nullptr;
+        hit += secondsSince(start);
+        start = chrono::steady_clock::now();
+        for (const Key& k : missing)
+            found += map.find(k) != nullptr;
+        miss += secondsSince(start);
+    }
+    double operations = (double)keys.size() * rounds;
+    cout << "  " << label << ": insert " << operations / insert / 1e6 << " M/s, hit "
+         << operations / hit / 1e6 << " M/s, miss " << missing.size() * rounds / miss / 1e6 << " M/s, "
+         << allocations / rounds << " allocations"
+         << (found == keys.size() * rounds ? "" : " (WRONG LOOKUP RESULTS)") << endl;
+}
+
+  // hashmap [rounds]: ExpandableHashMap against FlatHashMap on this project's key types
+static int benchHashMap(int argc, char* argv[])
+{
+    int rounds = argc > 0 ? atoi(argv[0]) : 5;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+
+    // every map coordinate, as the router's visited map sees them, and
+    // coordinates that are nowhere on the map
+    vector<GeoCoord> coords, offMap;
+    for (NodeId n = 0; n < graph.nodeCount(); n++)
+    {
+        coords.push_back(graph.coord(n));
+        GeoCoord gc = coords.back();
+        gc.latitudeText += "5";
+        offMap.push_back(gc);
+    }
+    cout << "GeoCoord -> GeoCoord, " << coords.size() << " keys" << endl;
+    benchMapWorkload<ExpandableHashMap<GeoCoord, GeoCoord>>("ExpandableHashMap", coords, offMap, GeoCoord(), rounds);
+    benchMapWorkload<FlatHashMap<GeoCoord, GeoCoord>>("FlatHashMap      ", coords, offMap, GeoCoord(), rounds);
+
+    // street names, and a coordinate-text workload with many more string keys
+    vector<string> names, missingNames;
+    for (uint32_t i = 0; i < graph.nameCount(); i++)
+    {
+        names.push_back(graph.name(i));
+        missingNames.push_back(names.back() + " Extension");
+    }
+    cout << "string -> double, " << names.size() << " street names" << endl;
+    benchMapWorkload<ExpandableHashMap<string, double>>("ExpandableHashMap", names, missingNames, 1.0, rounds * 20);
+    benchMapWorkload<FlatHashMap<string, double>>("FlatHashMap      ", names, missingNames, 1.0, rounds * 20);
+
+    vector<string> texts, missingTexts;
+    for (const GeoCoord& gc : coords)
+    {
+        texts.push_back(gc.latitudeText + "," + gc.longitudeText);
+        missingTexts.push_back(gc.longitudeText + "," + gc.latitudeText);
+    }
+    cout << "string -> double, " << texts.size() << " coordinate strings" << endl;
+    benchMapWorkload<ExpandableHashMap<string, double>>("ExpandableHashMap", texts, missingTexts, 1.0, rounds);
+    benchMapWorkload<FlatHashMap<string, double>>("FlatHashMap      ", texts, missingTexts, 1.0, rounds);
+    return 0;
+}
+
+  // rehash [keys]: worst single associate while an ExpandableHashMap grows
+static int benchRehash(int argc, char* argv[])
+{
+    int count = argc > 0 ? atoi(argv[0]) : 1000000;
+    vector<string> keys(count);
+    char text[64];
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(text, sizeof(text), "%.7f%.7f", 34.0 + (i % 1000) * 0.0001, -118.5 + (i / 1000) * 0.0001);
+        keys[i] = text;
+    }
+
+    const char* labels[] = { "rehash all at once", "incremental rehash", "reserve(n) first  " };
+    for (int mode = 0; mode < 3; mode++)
+    {
+        ExpandableHashMap<string, int> map(0.5, mode == 1);
+        if (mode == 2)
+            map.reserve(count);
+        vector<double> latency(count);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            auto before = chrono::steady_clock::now();
+            map.associate(keys[i], i);
+            latency[i] = secondsSince(before);
+        }
+        double total = secondsSince(start);
+        int found = 0;
+        for (int i = 0; i < count; i++)
+            found += map.find(keys[i]) != nullptr && *map.find(keys[i]) == i;
+        sort(latency.begin(), latency.end());
+        cout << labels[mode] << ": " << total << " s for " << count << " associates, p99.9 "
+             << latency[count - 1 - count / 1000] * 1e6 << " us, worst " << latency[count - 1] * 1e3 << " ms"
+             << (found == count ? "" : ", LOOKUPS WRONG") << endl;
+    }
+    return 0;
+}
+
+  // a GeoCoord key hashed the way hasher(GeoCoord) used to: by building
+  // latitudeText + longitudeText and hashing that
+struct ConcatenatedCoord
+{
+    GeoCoord gc;
+};
+
+bool operator==(const ConcatenatedCoord& lhs, const ConcatenatedCoord& rhs)
+{
+    return lhs.gc == rhs.gc;
+}
+
+unsigned int hasher(const ConcatenatedCoord& k)
+{
+    return std::hash<string>()(k.gc.latitudeText + k.gc.longitudeText);
+}
+
+template<typename Map, typename Key>
+static void benchLookups(const char* label, const vector<Key>& keys, int rounds)
+{
+    Map map;
+    for (const Key& k : keys)
+        map.associate(k, 1);
+    size_t found = 0;
+    size_t before = heapAllocations;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (const Key& k : keys)
+            found += map.find(k) != nullptr;
+    }
+    double seconds = secondsSince(start);
+    double lookups = (double)keys.size() * rounds;
+    cout << "  " << label << ": " << lookups / seconds / 1e6 << " M lookups/s, "
+         << (heapAllocations - before) / lookups << " allocations/lookup"
+         << (found == keys.size() * rounds ? "" : " (WRONG LOOKUP RESULTS)") << endl;
+}
+
+  // lookups [rounds]: GeoCoord lookups/s with the old and the current hasher
+static int benchGeoLookups(int argc, char* argv[])
+{
+    int rounds = argc > 0 ? atoi(argv[0]) : 20;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    vector<GeoCoord> coords;
+    vector<ConcatenatedCoord> concatenated;
+    for (NodeId n = 0; n < graph.nodeCount(); n++)
+    {
+        coords.push_back(graph.coord(n));
+        ConcatenatedCoord k = { coords.back() };
+        concatenated.push_back(k);
+    }
+    cout << coords.size() << " map coordinates, " << rounds << " rounds" << endl;
+    benchLookups<ExpandableHashMap<ConcatenatedCoord, int>>("ExpandableHashMap, concatenating hasher", concatenated, rounds);
+    benchLookups<ExpandableHashMap<GeoCoord, int>>("ExpandableHashMap, streaming hasher    ", coords, rounds);
+    benchLookups<FlatHashMap<ConcatenatedCoord, int>>("FlatHashMap, concatenating hasher      ", concatenated, rounds);
+    benchLookups<FlatHashMap<GeoCoord, int>>("FlatHashMap, streaming hasher          ", coords, rounds);
+    return 0;
+}
+
+  // arena [queries]: heap allocations of routing and of per-query hash maps
+static int benchArena(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 100;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(3);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    while ((int)pairs.size() < queries)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        if (distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b)) < 2)
+            pairs.push_back(make_pair(graph.coord(a), graph.coord(b)));
+    }
+
+    for (int contracted = 0; contracted < 2; contracted++)
+    {
+        if (contracted)
+            sm.contractChains();
+        PointToPointRouter router(&sm);
+        vector<SegmentRef> route;
+        double miles;
+        router.generatePointToPointRoute(pairs[0].first, pairs[0].second, route, miles); // warm up
+        size_t before = heapAllocations;
+        auto start = chrono::steady_clock::now();
+        for (const auto& p : pairs)
+            router.generatePointToPointRoute(p.first, p.second, route, miles);
+        double seconds = secondsSince(start);
+        cout << (contracted ? "router, chains:     " : "router, full graph: ") << pairs.size() / seconds << " routes/s, "
+             << (heapAllocations - before) / (double)pairs.size() << " heap allocations/route" << endl;
+    }
+
+    // a query-sized map of coordinates, built and thrown away over and over
+    vector<GeoCoord> coords;
+    for (NodeId n = 0; n < graph.nodeCount() && coords.size() < 2000; n++)
+        coords.push_back(graph.coord(n));
+    int rounds = 200;
+    Arena arena;
+    for (int useArena = 0; useArena < 2; useArena++)
+    {
+        size_t before = heapAllocations;
+        auto start = chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+        {
+            if (useArena)
+            {
+                arena.reset();
+                ExpandableHashMap<GeoCoord, NodeId, ArenaAllocator<char>> map(0.5, false, ArenaAllocator<char>(arena));
+                for (size_t i = 0; i < coords.size(); i++)
+                    map.associate(coords[i], (NodeId)i);
+            }
+            else
+            {
+                ExpandableHashMap<GeoCoord, NodeId> map;
+                for (size_t i = 0; i < coords.size(); i++)
+                    map.associate(coords[i], (NodeId)i);
+            }
+        }
+        double seconds = secondsSince(start);
+        cout << (useArena ? "ExpandableHashMap, arena:         " : "ExpandableHashMap, std::allocator: ")
+             << rounds / seconds << " maps/s of " << coords.size() << " entries, "
+             << (heapAllocations - before) / (double)rounds << " heap allocations/map" << endl;
+    }
+    return 0;
+}
+
+  // workspace [queries]: short routes on mapdata.txt searched in one reused
+  // workspace against a new workspace for every query, in each search mode
+static int benchWorkspace(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 1000;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    mt19937 random(41);
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    while ((int)pairs.size() < queries)
+    {
+        NodeId a = anyNode(random), b = anyNode(random);
+        if (distanceEarthMiles(graph.latitude(a), graph.longitude(a), graph.latitude(b), graph.longitude(b)) < 1)
+            pairs.push_back(make_pair(graph.coord(a), graph.coord(b)));
+    }
+    cout << file << ": " << pairs.size() << " routes under a mile, " << graph.nodeCount() << " nodes" << endl;
+
+    const char* modes[] = { "A*           ", "bidirectional", "hierarchy    " };
+    for (int mode = 0; mode < 3; mode++)
+    {
+        if (mode == 2)
+            sm.buildHierarchy();
+        PointToPointRouter router(&sm);
+        router.setSearchMode(mode == 1 ? SEARCH_BIDIRECTIONAL : SEARCH_UNIDIRECTIONAL);
+        vector<SegmentRef> route;
+        double miles;
+        SearchWorkspace reused;
+        for (const auto& p : pairs) // warm up: the labels, the heaps and route reach full size
+            router.generatePointToPointRoute(p.first, p.second, route, miles, reused);
+        double total[2] = { 0, 0 };
+        for (int fresh = 0; fresh < 2; fresh++)
+        {
+            size_t before = heapAllocations;
+            auto start = chrono::steady_clock::now();
+            for (const auto& p : pairs)
+            {
+                if (fresh)
+                {
+                    SearchWorkspace workspace;
+                    router.generatePointToPointRoute(p.first, p.second, route, miles, workspace);
+                }
+                else
+                    router.generatePointToPointRoute(p.first, p.second, route, miles, reused);
+                total[fresh] += miles;
+            }
+            double seconds = secondsSince(start);
+            cout << modes[mode] << (fresh ? ", new workspace: " : ", reused:        ") << pairs.size() / seconds
+                 << " routes/s, " << (heapAllocations - before) / (double)pairs.size() << " heap allocations/route" << endl;
+        }
+        if (total[0] != total[1])
+            cout << "  MILES DIFFER" << endl;
+    }
+    SearchWorkspace workspace;
+    workspace.begin(graph.nodeCount());
+    cout << "one workspace holds " << workspace.memoryUsage() / 1024 << " KiB of labels" << endl;
+    return 0;
+}
+
+  // random traffic for graph in file: lines slowed segments, one in twenty closed
+static bool writeTraffic(const string& file, const StreetGraph& graph, int lines, mt19937& random)
+{
+    FILE* out = fopen(file.c_str(), "w");
+    if (out == nullptr) return false;
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    uniform_real_distribution<double> factor(1.5, 4);
+    fprintf(out, "# %d segments of random traffic\n", lines);
+    for (int i = 0; i < lines; i++)
+    {
+        NodeId a = anyNode(random);
+        if (graph.edgeBegin(a) == graph.edgeEnd(a)) continue;
+        EdgeId e = graph.edgeBegin(a) + random() % (graph.edgeEnd(a) - graph.edgeBegin(a));
+        GeoCoord from = graph.coord(a), to = graph.coord(graph.edgeTarget(e));
+        fprintf(out, "%s %s %s %s ", from.latitudeText.c_str(), from.longitudeText.c_str(),
+                to.latitudeText.c_str(), to.longitudeText.c_str());
+        if (i % 20 == 0)
+            fprintf(out, "closed\n");
+        else
+            fprintf(out, "%.2f\n", factor(random));
+    }
+    return fclose(out) == 0;
+}
+
+  // queries between random nodes of sm routed by its overlay: routes per
+  // second, and how many are valid and as cheap as Dijkstra under weights
+static bool checkOverlayRoutes(const StreetMap& sm, const vector<double>& weights, int queries, mt19937& random)
+{
+    const StreetGraph& graph = sm.graph();
+    const CellOverlay& overlay = *sm.overlay();
+    shared_ptr<const CellOverlay::Metric> metric = overlay.metric();
+    uniform_int_distribution<NodeId> anyNode(0, graph.nodeCount() - 1);
+    vector<pair<NodeId, NodeId>> pairs;
+    for (int i = 0; i < queries; i++)
+        pairs.push_back(make_pair(anyNode(random), anyNode(random)));
+
+    SearchWorkspace workspace;
+    vector<vector<SegmentRef>> routes(pairs.size());
+    vector<double> costs(pairs.size());
+    vector<bool> found(pairs.size());
+    size_t expanded = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        workspace.begin(graph.nodeCount());
+        found[i] = overlay.route(*metric, pairs[i].first, pairs[i].second, workspace, routes[i], costs[i]);
+        expanded += workspace.nodesExpanded();
+    }
+    double seconds = secondsSince(start);
+
+    int valid = 0, reachable = 0;
+    double miles = 0;
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        double best = referenceDistance(graph, pairs[i].first, pairs[i].second, &weights);
+        reachable += best < numeric_limits<double>::infinity();
+        if (!found[i])
+        {
+            valid += best == numeric_limits<double>::infinity();
+            continue;
+        }
+        double length = 0, cost = 0;
+        for (const SegmentRef& seg : routes[i])
+        {
+            length += seg.length();
+            cost += weights[seg.edge()];
+        }
+        miles += length;
+        if (validRoute(routes[i], pairs[i].first, pairs[i].second, length) &&
+            fabs(cost - best) < 1e-9 && fabs(cost - costs[i]) < 1e-9)
+            valid++;
+    }
+    cout << "  " << pairs.size() / seconds << " routes/s (" << seconds / pairs.size() * 1e6 << " us each), "
+         << expanded / (double)pairs.size() << " nodes expanded, " << reachable << " reachable" << endl;
+    cout << "  " << valid << " of " << pairs.size() << " routes valid and as cheap as Dijkstra's" << endl;
+    return valid == (int)pairs.size();
+}
+
+static bool benchOverlayOn(const string& file, int queries, int lines)
+{
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return false;
+    }
+    const StreetGraph& graph = sm.graph();
+    cout << file << ": " << graph.nodeCount() << " nodes" << endl;
+    auto start = chrono::steady_clock::now();
+    sm.buildOverlay();
+    double buildSeconds = secondsSince(start);
+    const CellOverlay& overlay = *sm.overlay();
+    cout << "partitioned and customized in " << buildSeconds * 1000 << " ms, "
+         << overlay.memoryUsage() / 1024 << " KiB" << endl;
+    for (int level = 1; level <= overlay.levels(); level++)
+        cout << "  level " << level << ": " << overlay.cellCount(level) << " cells, "
+             << overlay.boundaryCount(level) << " boundary nodes" << endl;
+
+    mt19937 random(47);
+    vector<double> lengths(graph.edgeCount());
+    for (EdgeId e = 0; e < graph.edgeCount(); e++)
+        lengths[e] = graph.edgeLength(e);
+    cout << "with segment lengths:" << endl;
+    bool ok = checkOverlayRoutes(sm, lengths, queries, random);
+
+    string traffic = "synthetic_traffic.txt";
+    if (!writeTraffic(traffic, graph, lines, random))
+    {
+        cout << "Unable to write " << traffic << endl;
+        return false;
+    }
+    start = chrono::steady_clock::now();
+    ok = sm.applyTraffic(traffic) && ok;
+    double serialSeconds = secondsSince(start);
+    ThreadPool pool;
+    start = chrono::steady_clock::now();
+    ok = sm.applyTraffic(traffic, &pool) && ok;
+    double poolSeconds = secondsSince(start);
+    vector<double> weights;
+    string error;
+    ok = overlay.readTraffic(traffic, weights, error) && ok;
+    remove(traffic.c_str());
+    cout << "applied " << lines << " lines of traffic in " << serialSeconds * 1000 << " ms on one thread, "
+         << poolSeconds * 1000 << " ms on " << pool.threadCount() << endl;
+    cout << "with traffic:" << endl;
+    return checkOverlayRoutes(sm, weights, queries, random) && ok;
+}
+
+  // overlay [queries] [traffic lines] [grid side]: the cell overlay on
+  // mapdata.txt and a synthetic grid, customized with segment lengths and
+  // again with random traffic, its routes checked against Dijkstra's
+static int benchOverlay(int argc, char* argv[])
+{
+    int queries = argc > 0 ? atoi(argv[0]) : 1000;
+    int lines = argc > 1 ? atoi(argv[1]) : 2000;
+    int side = argc > 2 ? atoi(argv[2]) : 300;
+    bool ok = benchOverlayOn("Sources/mapdata.txt", queries, lines);
+    string file = "synthetic_map.txt";
+    if (!writeSyntheticMap(file, side))
+    {
+        cout << "Unable to write " << file << endl;
+        return 1;
+    }
+    ok = benchOverlayOn(file, queries / 10, lines * 10) && ok;
+    remove(file.c_str());
+    return ok ? 0 : 1;
+}
+
+  // concurrent [max threads] [operations per thread]: ConcurrentHashMap under
+  // a 90% find / 10% associate mix, against one lock around one map
+static int benchConcurrent(int argc, char* argv[])
+{
+    int maxThreads = argc > 0 ? atoi(argv[0]) : 64;
+    int operations = argc > 1 ? atoi(argv[1]) : 200000;
+    string file = "Sources/mapdata.txt";
+    StreetMap sm;
+    if (!sm.load(file))
+    {
+        cout << "Unable to load " << file << endl;
+        return 1;
+    }
+    const StreetGraph& graph = sm.graph();
+    vector<GeoCoord> coords;
+    for (NodeId n = 0; n < graph.nodeCount(); n++)
+        coords.push_back(graph.coord(n));
+
+    cout << "threads   1 shard (Mops/s)   " << CONCURRENT_DEFAULT_SHARDS << " shards (Mops/s)" << endl;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double rates[2];
+        for (int variant = 0; variant < 2; variant++)
+        {
+            ConcurrentHashMap<GeoCoord, NodeId> map(variant == 0 ? 1 : CONCURRENT_DEFAULT_SHARDS);
+            for (NodeId n = 0; n < coords.size(); n += 2) // half the keys present up front
+                map.associate(coords[n], n);
+            atomic<size_t> hits(0);
+            auto worker = [&](int t) {
+                mt19937 random(t);
+                uniform_int_distribution<size_t> anyKey(0, coords.size() - 1);
+                size_t found = 0;
+                NodeId value;
+                for (int i = 0; i < operations; i++)
+                {
+                    size_t k = anyKey(random);
+                    if (i % 10 == 0)
+                        map.associate(coords[k], (NodeId)k);
+                    else
+                        found += map.find(coords[k], value) && value == k;
+                }
+                hits += found;
+            };
+            auto start = chrono::steady_clock::now();
+            vector<thread> pool;
+            for (int t = 0; t < threads; t++)
+                pool.push_back(thread(worker, t));
+            for (thread& t : pool)
+                t.join();
+            rates[variant] = (double)threads * operations / secondsSince(start) / 1e6;
+        }
+        printf("%7d   %16.2f   %17.2f\n", threads, rates[0], rates[1]);
+    }
+    cout << "(" << defaultThreadCount() << " hardware threads on this machine)" << endl;
+    return 0;
+}
+
+struct Benchmark
+{
+    const char* name;
+    const char* usage;
+    int (*run)(int argc, char* argv[]);
+};
+
+static const Benchmark benchmarks[] = {
+    { "parse", "parse [megabytes]", benchParse },
+    { "load", "load [megabytes] [max threads]", benchLoad },
+    { "memory", "memory [mapdata.txt]", benchMemory },
+    { "snap", "snap [mapdata.txt] [points]", benchSnap },
+    { "route", "route [queries] [grid side]", benchRoute },
+    { "chains", "chains [queries]", benchChains },
+    { "astar", "astar [queries]", benchAStar },
+    { "bidirectional", "bidirectional [queries] [min miles]", benchBidirectional },
+    { "hierarchy", "hierarchy [queries]", benchHierarchy },
+    { "landmarks", "landmarks [queries] [count]", benchLandmarks },
+    { "cache", "cache [plans] [capacity]", benchRouteCache },
+    { "matrix", "matrix [stops]", benchMatrix },
+    { "nearest", "nearest [targets] [k]", benchNearest },
+    { "pool", "pool [stops] [threads]", benchPool },
+    { "hashmap", "hashmap [rounds]", benchHashMap },
+    { "rehash", "rehash [keys]", benchRehash },
+    { "lookups", "lookups [rounds]", benchGeoLookups },
+    { "arena", "arena [queries]", benchArena },
+    { "workspace", "workspace [queries]", benchWorkspace },
+    { "overlay", "overlay [queries] [traffic lines] [grid side]", benchOverlay },
+    { "concurrent", "concurrent [max threads] [operations per thread]", benchConcurrent },
+};
+
+int main(int argc, char* argv[])
+{
+    for (const Benchmark& b : benchmarks)
+    {
+        if (argc >= 2 && argv[1] == string(b.name))
+            return b.run(argc - 2, argv + 2);
+    }
+    cout << "Usage: " << argv[0] << " <benchmark> [args]" << endl;
+    for (const Benchmark& b : benchmarks)
+        cout << "  " << b.usage << endl;
+    return 1;
+}
@@ -0,0 +1,43 @@
+// mapcompile.cpp
+//
+// Compiles mapdata.txt into a binary map snapshot that StreetMap::load can
+// mmap directly, and optionally builds the snapshot's contraction hierarchy
+// for StreetMap::loadHierarchy.  Build from the repository root with
+//
+//   c++ -std=c++14 -O2 -ISources Tools/mapcompile.cpp $(ls Sources/*.cpp | grep -v main.cpp) -o mapcompile
+
+#include "provided.h"
+#include "MapSnapshot.h"
+#include <iostream>
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        cout << "Usage: " << argv[0] << " mapdata.txt mapdata.snap [mapdata.ch]" << endl;
+        return 1;
+    }
+    if (!compileMapSnapshot(argv[1], argv[2]))
+    {
+        cout << "Unable to compile " << argv[1] << " into " << argv[2] << endl;
+        return 1;
+    }
+    if (argc == 4)
+    {
+        // built over the snapshot itself, so node ids match whoever loads it
+        StreetMap sm;
+        if (!sm.load(argv[2]))
+        {
+            cout << "Unable to load " << argv[2] << endl;
+            return 1;
+        }
+        sm.buildHierarchy();
+        if (!sm.saveHierarchy(argv[3]))
+        {
+            cout << "Unable to write " << argv[3] << endl;
+            return 1;
+        }
+    }
+    return 0;
+}